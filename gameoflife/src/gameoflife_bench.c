@@ -0,0 +1,338 @@
+/*
+ * Game of Life evolve kernel benchmark
+ *
+ * Usage:
+ *  ./gameoflife_bench [-k KERNELS] [-i ISA] [-t THREADS] [-g GENS] [-n REPS] [-w WARMUP] [-o CSVFILE] BOARD...
+ *
+ *  KERNELS is a comma-separated list of kernels (default: all of them)
+ *  ISA is the instruction set for the simd kernels
+ *  THREADS is the number of evolve threads
+ *  GENS is the number of generations of each run
+ *  REPS is the number of timed runs per kernel and board
+ *  WARMUP is the number of untimed runs before them
+ *  CSVFILE receives one line per kernel and board (default: stdout)
+ *  BOARD is an input file, sized after its name (e.g., gol_grow_40_80.input,
+ *  gol_1k.input) or explicitly as FILE:ROWSxCOLS, or a random board as
+ *  random:ROWSxCOLS:DENSITY
+ *
+ * Every run starts from the initial board and its checksum and population
+ * are verified against the byte kernel. The exit status is 1 if any run
+ * does not match.
+ *
+ * e.g.,
+ *  ./gameoflife_bench -g 200 data/gol_1k.input random:1024x1024:0.05
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "gol_common.h"
+
+#define EXIT_OK       0
+#define ERROR_ARGS    1
+#define ERROR_VERIFY  1
+
+#define DEFAULT_BENCH_GENS   100
+#define DEFAULT_BENCH_REPS   5
+#define DEFAULT_BENCH_WARMUP 1
+#define REFERENCE_KERNEL     "byte"
+
+typedef struct {
+  const char * name;  /* board as given in the command line */
+  int rows, cols;
+  char * cells;       /* rows x cols initial cells */
+} board;
+
+static void swap_halo(state * s);
+static int load_board(const char * spec, board * b);
+static long run(state * s, const board * b, const options * opts, int gens, double * time);
+static size_t heap_bytes(void);
+
+int main(int argc, char **argv)
+{
+  options opts;
+  const char * kernel_list = NULL, * csv_filename = NULL;
+  int gens = DEFAULT_BENCH_GENS, reps = DEFAULT_BENCH_REPS, warmup = DEFAULT_BENCH_WARMUP;
+  int opt, failed = 0;
+  FILE * csv = stdout;
+
+  memset(&opts, 0, sizeof(opts));
+  opts.isa = DEFAULT_ISA;
+  opts.tile = DEFAULT_TILE;
+  opts.depth = DEFAULT_DEPTH;
+  opts.threads = DEFAULT_THREADS;
+  opts.schedule = SCHEDULE_STATIC;
+  opts.block = BLOCK_AUTO;
+  opts.rule = DEFAULT_RULE;
+  opts.birth = RULE_CONWAY_B;
+  opts.survive = RULE_CONWAY_S;
+  opts.radius = 1;
+
+  while ((opt = getopt(argc, argv, "k:i:t:g:n:w:o:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'k': kernel_list = optarg; break;
+      case 'i': opts.isa = optarg; break;
+      case 't': opts.threads = atoi(optarg); break;
+      case 'g': gens = atoi(optarg); break;
+      case 'n': reps = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      case 'o': csv_filename = optarg; break;
+      default:  optind = argc + 1;
+    }
+  }
+  if (optind >= argc || gens <= 0 || reps <= 0 || warmup < 0 || opts.threads < 0)
+  {
+    printf("Usage: %s [-k KERNELS] [-i ISA] [-t THREADS] [-g GENS] [-n REPS] [-w WARMUP] [-o CSVFILE] BOARD...\n", argv[0]);
+    printf("  BOARD is FILE, FILE:ROWSxCOLS or random:ROWSxCOLS:DENSITY\n");
+    return ERROR_ARGS;
+  }
+
+  if (csv_filename && !(csv = fopen(csv_filename, "w")))
+  {
+    fprintf(stderr, "Error: %s %s\n", strerror(errno), csv_filename);
+    exit(errno);
+  }
+  fprintf(csv, "board,rows,cols,density,kernel,isa,threads,gens,reps,"
+               "mean_s,stddev_s,rsd_pct,cells_per_s,best_cells_per_s,bytes_per_cell,"
+               "checksum,population,verified\n");
+
+  for (int a = optind; a < argc; ++a)
+  {
+    board b;
+    state s;
+    double time;
+    long ref_checksum, ref_population;
+
+    if (!load_board(argv[a], &b))
+      exit(ERROR_ARGS);
+
+    /* reference checksum and population */
+    opts.kernel = REFERENCE_KERNEL;
+    alloc_state(&s, b.rows, b.cols, 1);
+    ref_checksum = run(&s, &b, &opts, gens, &time);
+    ref_population = s.population;
+    free_state(&s);
+
+    long live = 0;
+    for (size_t i = 0; i < (size_t) b.rows * b.cols; ++i)
+      live += b.cells[i];
+    double density = (double) live / ((double) b.rows * b.cols);
+    printf("%s (%dx%d, density %.3f), %d generations: checksum %ld, population %ld\n",
+           b.name, b.rows, b.cols, density, gens, ref_checksum, ref_population);
+
+    for (int k = 0; get_kernel(k); ++k)
+    {
+      const gol_kernel * kernel = get_kernel(k);
+      double * times, mean = 0, var = 0, best = INFINITY;
+      long checksum = 0, population = 0;
+      int verified = 1;
+
+      if (kernel_list)
+      {
+        /* exact match within the comma-separated list */
+        const char * p = kernel_list;
+        size_t len = strlen(kernel->name);
+        while ((p = strstr(p, kernel->name)) &&
+               !((p == kernel_list || p[-1] == ',') && (p[len] == ',' || !p[len])))
+          ++p;
+        if (!p)
+          continue;
+      }
+      /* Larger than Life kernels do not run Conway's rule */
+      if (kernel->ltl)
+        continue;
+
+      opts.kernel = kernel->name;
+      times = (double *) malloc(reps * sizeof(double));
+      size_t heap = heap_bytes();
+      alloc_state(&s, b.rows, b.cols, 1);
+      for (int r = 0; r < warmup + reps; ++r)
+      {
+        checksum = run(&s, &b, &opts, gens, &time);
+        population = s.population;
+        verified &= checksum == ref_checksum && population == ref_population;
+        if (r >= warmup)
+          times[r - warmup] = time;
+      }
+      double bytes_per_cell = (double) (heap_bytes() - heap) / ((double) b.rows * b.cols);
+      free_state(&s);
+
+      for (int r = 0; r < reps; ++r)
+      {
+        mean += times[r] / reps;
+        best = times[r] < best ? times[r] : best;
+      }
+      for (int r = 0; r < reps; ++r)
+        var += (times[r] - mean) * (times[r] - mean) / (reps > 1 ? reps - 1 : 1);
+      free(times);
+
+      double cells = (double) b.rows * b.cols * gens;
+      printf("  %-8s %10.3e cells/s (best %10.3e, +-%5.1f%%), %6.2f bytes/cell%s\n",
+             kernel->name, cells / mean, cells / best, 100 * sqrt(var) / mean,
+             bytes_per_cell, verified ? "" : "  CHECKSUM MISMATCH");
+      fprintf(csv, "%s,%d,%d,%.4f,%s,%s,%d,%d,%d,%.6e,%.6e,%.2f,%.6e,%.6e,%.3f,%ld,%ld,%d\n",
+              b.name, b.rows, b.cols, density, kernel->name, opts.isa, opts.threads, gens, reps,
+              mean, sqrt(var), 100 * sqrt(var) / mean, cells / mean, cells / best,
+              bytes_per_cell, checksum, population, verified);
+      fflush(csv);
+      failed |= !verified;
+    }
+    free(b.cells);
+  }
+
+  if (csv != stdout)
+    fclose(csv);
+  return failed ? ERROR_VERIFY : EXIT_OK;
+}
+
+/*
+ * Evolve a board from its initial cells with a kernel, as gameoflife_seq
+ * does. Returns the checksum, the time of the generations in `time`
+ */
+static long run(state * s, const board * b, const options * opts, int gens, double * time)
+{
+  /* set_kernel sets up the kernel data again from the initial board */
+  for (int y = 0; y < s->rows + 2*s->halo; ++y)
+  {
+    memset(SPACE_ROW(s, y), 0, s->cols + 2*s->halo);
+    memset(NEXT_ROW(s, y), 0, s->cols + 2*s->halo);
+  }
+  for (int y = 0; y < s->rows; ++y)
+    memcpy(SPACE_ROW(s, y + s->halo) + s->halo, b->cells + (size_t) y * b->cols, b->cols);
+  s->generation = 0;
+  s->checksum = 0;
+
+  if (!set_kernel(s, opts))
+  {
+    fprintf(stderr, "Error: cannot use kernel '%s'\n", opts->kernel);
+    exit(ERROR_ARGS);
+  }
+
+  double start = wall_time();
+  while (s->generation < gens)
+  {
+    swap_halo(s);
+    evolve(s);
+  }
+  *time = wall_time() - start;
+  return s->checksum;
+}
+
+/*
+ * Place bounding rows, columns and corners into adjacent halos
+ */
+static void swap_halo(state * s)
+{
+  int h = s->halo;
+
+  for (int y = 0; y < h; y++)
+  {
+    memcpy(SPACE_ROW(s, y) + h, SPACE_ROW(s, s->rows+y) + h, s->cols);
+    memcpy(SPACE_ROW(s, s->rows+h+y) + h, SPACE_ROW(s, h+y) + h, s->cols);
+  }
+
+  for (int y = 0; y < s->rows+2*h; y++)
+  {
+    char * row = SPACE_ROW(s, y);
+    memcpy(row, row + s->cols, h);
+    memcpy(row + s->cols+h, row + h, h);
+  }
+}
+
+/* xorshift64*, so that random boards are the same on every machine */
+static uint64_t next_random(uint64_t * x)
+{
+  *x ^= *x >> 12;
+  *x ^= *x << 25;
+  *x ^= *x >> 27;
+  return *x * 0x2545f4914f6cdd1dULL;
+}
+
+/* parse a board spec and read or generate its cells */
+static int load_board(const char * spec, board * b)
+{
+  char filename[4096];
+  double density;
+
+  b->name = spec;
+  b->rows = b->cols = 0;
+
+  if (sscanf(spec, "random:%dx%d:%lf", &b->rows, &b->cols, &density) == 3)
+  {
+    uint64_t x = 88172645463325252ULL;
+
+    if (b->rows <= 0 || b->cols <= 0 || density < 0 || density > 1)
+      return 0;
+    b->cells = (char *) malloc((size_t) b->rows * b->cols);
+    for (size_t i = 0; i < (size_t) b->rows * b->cols; ++i)
+      b->cells[i] = (next_random(&x) >> 11) * (1.0 / 9007199254740992.0) < density;
+    return 1;
+  }
+
+  snprintf(filename, sizeof(filename), "%s", spec);
+  char * size = strrchr(filename, ':');
+  if (size)
+  {
+    *size++ = '\0';
+    sscanf(size, "%dx%d", &b->rows, &b->cols);
+  }
+  else
+  {
+    /* size from the name: ..._ROWS_COLS.input or ..._Nk.input (N*1024 square) */
+    const char * base = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+    const char * p = strrchr(base, '_');
+    int n, end = 0;
+
+    if (p && sscanf(p, "_%dk.input%n", &n, &end) == 1 && end)
+      b->rows = b->cols = n * 1024;
+    else if (p)
+    {
+      const char * q = p;
+      while (q > base && *--q != '_');
+      if (*q == '_')
+        sscanf(q, "_%d_%d.input", &b->rows, &b->cols);
+    }
+  }
+  if (b->rows <= 0 || b->cols <= 0)
+  {
+    fprintf(stderr, "Error: unknown size of board '%s', use FILE:ROWSxCOLS\n", spec);
+    return 0;
+  }
+
+  FILE * ifile = fopen(filename, "r");
+  if (!ifile)
+  {
+    fprintf(stderr, "Error: %s %s\n", strerror(errno), filename);
+    return 0;
+  }
+  b->cells = (char *) malloc((size_t) b->rows * b->cols);
+  size_t readcnt = fread(b->cells, sizeof(char), (size_t) b->rows * b->cols, ifile);
+  fclose(ifile);
+  if (readcnt != (size_t) b->rows * b->cols)
+  {
+    fprintf(stderr, "ERROR, syntax error in '%s'. fread returned %zu instead of %zu\n",
+            filename, readcnt, (size_t) b->rows * b->cols);
+    free(b->cells);
+    return 0;
+  }
+  return 1;
+}
+
+/* heap in use, to measure the memory of the planes and kernel data */
+static size_t heap_bytes(void)
+{
+#ifdef __GLIBC__
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
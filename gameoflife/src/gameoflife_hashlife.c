@@ -0,0 +1,617 @@
+/*
+ * Game of Life (HashLife)
+ *
+ * The board is stored as a canonicalized quadtree: every node is built
+ * through a hash-consed node cache, so identical subtrees are stored once,
+ * and the result of advancing each node is memoized. This allows jumping
+ * 2^k generations at once for structured patterns.
+ *
+ * HashLife works on an infinite plane, while the game space is a periodic
+ * grid. The infinite plane holding the periodic tiling of the board evolves
+ * exactly as the board does, so each jump is computed on a quadtree window
+ * over that tiling, and the board is taken back from the result:
+ * - Boards with power-of-two sizes are stored as a square power-of-two
+ *   tiling (the universe) and never leave the quadtree form.
+ * - Other boards are rebuilt from the flat board on each jump, which limits
+ *   jumps to half the next power of two above the board size.
+ *
+ * Usage:
+ *  ./gameoflife_hashlife [-j JUMP] [-m NODES] FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]
+ *
+ *  JUMP is the log2 of the generations per jump (default: the largest
+ *       power of two not larger than GENS)
+ *  NODES is the node cache size that triggers garbage collection
+ *  FILENAME is the input binary file containing the starting state
+ *  ROWS/COLS is the size of the starting state
+ *  GENS is the number of generations
+ *  OUTPUT_BMPFILE is the picture of the final state
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "gol_common.h"
+
+#define WITH_HALO 1
+
+#define EXIT_OK    0
+#define ERROR_ARGS 1
+
+#define IOERR 1
+
+#define DEFAULT_MAX_NODES 4000000L
+#define MAX_LEVEL         62
+#define INITIAL_BUCKETS   (1 << 16)
+#define SLAB_NODES        4096
+
+typedef struct node {
+  struct node * nw, * ne, * sw, * se; /* children (leaves have none) */
+  struct node * result;  /* memoized center advanced 2^result_step generations */
+  struct node * next;    /* hash chain */
+  long population;
+  int level;             /* node holds 2^level x 2^level cells */
+  int result_step;
+  int mark;
+} node;
+
+typedef struct {
+  node ** buckets;
+  size_t nbuckets;
+  size_t count;          /* nodes in the cache */
+  size_t max_nodes;      /* collect garbage beyond this size */
+  node * free_list;
+  node * empty[MAX_LEVEL + 1]; /* canonical empty nodes */
+  long collections;
+} node_cache;
+
+static node dead_leaf  = {NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, -1, 0},
+            alive_leaf = {NULL, NULL, NULL, NULL, NULL, NULL, 1, 0, -1, 0};
+
+static node_cache cache;
+
+void print_state(state * s, const char * filename, int *gsize);
+int parse_hashlife_arguments(int argc, char *argv[], char **filename, int *gsize, int *max_gens,
+                             char **output_filename, int * jump, long * max_nodes);
+
+/****************************************/
+/* node cache                           */
+/****************************************/
+
+static inline size_t hash_node(const node * nw, const node * ne, const node * sw, const node * se)
+{
+  uint64_t h = (uintptr_t) nw;
+  h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t) ne;
+  h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t) sw;
+  h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t) se;
+  return (size_t) (h ^ (h >> 29));
+}
+
+static void rehash(size_t nbuckets)
+{
+  node ** buckets = (node **) calloc(nbuckets, sizeof(node *));
+
+  for (size_t i = 0; i < cache.nbuckets; ++i)
+  {
+    node * n = cache.buckets[i];
+    while (n)
+    {
+      node * next = n->next;
+      size_t b = hash_node(n->nw, n->ne, n->sw, n->se) & (nbuckets - 1);
+      n->next = buckets[b];
+      buckets[b] = n;
+      n = next;
+    }
+  }
+  free(cache.buckets);
+  cache.buckets = buckets;
+  cache.nbuckets = nbuckets;
+}
+
+static node * alloc_node(void)
+{
+  if (!cache.free_list)
+  {
+    /* slabs are never returned, freed nodes are recycled */
+    node * slab = (node *) malloc(SLAB_NODES * sizeof(node));
+    if (!slab)
+    {
+      fprintf(stderr, "Error: out of memory (%zu nodes)\n", cache.count);
+      exit(ENOMEM);
+    }
+    for (int i = 0; i < SLAB_NODES; ++i)
+    {
+      slab[i].next = cache.free_list;
+      cache.free_list = slab + i;
+    }
+  }
+  node * n = cache.free_list;
+  cache.free_list = n->next;
+  return n;
+}
+
+/* canonical node with children `nw`, `ne`, `sw` and `se` */
+static node * find_node(node * nw, node * ne, node * sw, node * se)
+{
+  size_t b = hash_node(nw, ne, sw, se) & (cache.nbuckets - 1);
+
+  for (node * n = cache.buckets[b]; n; n = n->next)
+    if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se)
+      return n;
+
+  node * n = alloc_node();
+  n->nw = nw;
+  n->ne = ne;
+  n->sw = sw;
+  n->se = se;
+  n->result = NULL;
+  n->result_step = -1;
+  n->mark = 0;
+  n->level = nw->level + 1;
+  n->population = nw->population + ne->population + sw->population + se->population;
+  n->next = cache.buckets[b];
+  cache.buckets[b] = n;
+
+  if (++cache.count > cache.nbuckets)
+    rehash(cache.nbuckets * 2);
+
+  return n;
+}
+
+static node * empty_node(int level)
+{
+  if (!level)
+    return &dead_leaf;
+  if (!cache.empty[level])
+  {
+    node * e = empty_node(level - 1);
+    cache.empty[level] = find_node(e, e, e, e);
+  }
+  return cache.empty[level];
+}
+
+static void init_cache(size_t max_nodes)
+{
+  memset(&cache, 0, sizeof(node_cache));
+  cache.max_nodes = max_nodes;
+  cache.nbuckets = INITIAL_BUCKETS;
+  cache.buckets = (node **) calloc(cache.nbuckets, sizeof(node *));
+}
+
+static void mark_node(node * n, int with_results)
+{
+  if (!n->level || n->mark)
+    return;
+  n->mark = 1;
+  mark_node(n->nw, with_results);
+  mark_node(n->ne, with_results);
+  mark_node(n->sw, with_results);
+  mark_node(n->se, with_results);
+  if (with_results && n->result)
+    mark_node(n->result, with_results);
+}
+
+/* free the nodes not reachable from `root` */
+static void collect(node * root, int with_results)
+{
+  if (!with_results)
+  {
+    for (size_t i = 0; i < cache.nbuckets; ++i)
+      for (node * n = cache.buckets[i]; n; n = n->next)
+      {
+        n->result = NULL;
+        n->result_step = -1;
+      }
+  }
+
+  mark_node(root, with_results);
+  for (int l = 1; l <= MAX_LEVEL; ++l)
+    if (cache.empty[l])
+      mark_node(cache.empty[l], with_results);
+
+  for (size_t i = 0; i < cache.nbuckets; ++i)
+  {
+    node ** link = &cache.buckets[i];
+    while (*link)
+    {
+      node * n = *link;
+      if (n->mark)
+      {
+        n->mark = 0;
+        link = &n->next;
+      }
+      else
+      {
+        *link = n->next;
+        n->next = cache.free_list;
+        cache.free_list = n;
+        --cache.count;
+      }
+    }
+  }
+  ++cache.collections;
+}
+
+/*
+ * Keep the cache bounded. Memoized results are kept if possible, otherwise
+ * only the nodes of `root` survive
+ */
+static void check_cache(node * root)
+{
+  if (cache.count <= cache.max_nodes)
+    return;
+
+  collect(root, 1);
+  if (cache.count > cache.max_nodes * 3 / 4)
+    collect(root, 0);
+}
+
+/****************************************/
+/* evolution                            */
+/****************************************/
+
+static inline int leaf_at(const node * n, int y, int x)
+{
+  /* n is a level 2 node */
+  const node * q = y < 2 ? (x < 2 ? n->nw : n->ne) : (x < 2 ? n->sw : n->se);
+  const node * l = (y & 1) ? ((x & 1) ? q->se : q->sw) : ((x & 1) ? q->ne : q->nw);
+  return l->population != 0;
+}
+
+/* 2x2 center of a 4x4 node, advanced one generation */
+static node * step_base(node * n)
+{
+  node * r[4];
+
+  for (int y = 1; y <= 2; ++y)
+  {
+    for (int x = 1; x <= 2; ++x)
+    {
+      int c = 0, cell = leaf_at(n, y, x);
+      for (int y1 = y - 1; y1 <= y + 1; ++y1)
+        for (int x1 = x - 1; x1 <= x + 1; ++x1)
+          c += leaf_at(n, y1, x1);
+      c -= cell;
+      r[2*(y-1) + (x-1)] = (c == 3 || (c == 2 && cell)) ? &alive_leaf : &dead_leaf;
+    }
+  }
+  return find_node(r[0], r[1], r[2], r[3]);
+}
+
+static node * centered(node * n)
+{
+  return find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+/*
+ * Center of node `n` (level L), advanced 2^j generations, 0 <= j <= L-2.
+ * The result is a node of level L-1.
+ */
+static node * step(node * n, int j)
+{
+  int level = n->level;
+
+  assert(j >= 0 && j <= level - 2);
+
+  if (!n->population)
+    return empty_node(level - 1);
+  if (n->result && n->result_step == j)
+    return n->result;
+
+  node * result;
+  if (level == 2)
+  {
+    result = step_base(n);
+  }
+  else
+  {
+    /* 4x4 grandchildren and the 9 overlapping nodes of level L-1 */
+    node * g[4][4] = {{n->nw->nw, n->nw->ne, n->ne->nw, n->ne->ne},
+                      {n->nw->sw, n->nw->se, n->ne->sw, n->ne->se},
+                      {n->sw->nw, n->sw->ne, n->se->nw, n->se->ne},
+                      {n->sw->sw, n->sw->se, n->se->sw, n->se->se}};
+    node * r[3][3];
+    int full = (j == level - 2);
+
+    for (int y = 0; y < 3; ++y)
+    {
+      for (int x = 0; x < 3; ++x)
+      {
+        node * m = find_node(g[y][x], g[y][x+1], g[y+1][x], g[y+1][x+1]);
+        /* first half of the generations, or none if going slower */
+        r[y][x] = full ? step(m, level - 3) : centered(m);
+      }
+    }
+
+    int j2 = full ? level - 3 : j;
+    result = find_node(step(find_node(r[0][0], r[0][1], r[1][0], r[1][1]), j2),
+                       step(find_node(r[0][1], r[0][2], r[1][1], r[1][2]), j2),
+                       step(find_node(r[1][0], r[1][1], r[2][0], r[2][1]), j2),
+                       step(find_node(r[1][1], r[1][2], r[2][1], r[2][2]), j2));
+  }
+
+  n->result = result;
+  n->result_step = j;
+  return result;
+}
+
+/****************************************/
+/* conversion from/to the flat board    */
+/****************************************/
+
+typedef struct {
+  char * space;    /* board plane, halo included */
+  int stride;
+  int halo;
+  int rows, cols;
+  int oy, ox;      /* origin of the quadtree in the board tiling */
+} tiling;
+
+static inline int wrap(int v, int n)
+{
+  v %= n;
+  return v < 0 ? v + n : v;
+}
+
+/* node of level `level` at (y, x) of the periodic tiling of the board */
+static node * build(const tiling * t, int level, long y, long x)
+{
+  if (!level)
+  {
+    int by = wrap((int) ((y + t->oy) % t->rows), t->rows),
+        bx = wrap((int) ((x + t->ox) % t->cols), t->cols);
+    return PLANE_ROW(t->space, t->stride, by + t->halo)[bx + t->halo] ? &alive_leaf : &dead_leaf;
+  }
+
+  long half = 1L << (level - 1);
+  return find_node(build(t, level - 1, y, x),
+                   build(t, level - 1, y, x + half),
+                   build(t, level - 1, y + half, x),
+                   build(t, level - 1, y + half, x + half));
+}
+
+/* write the cells of `n` at (y, x) within the board */
+static void flatten(const node * n, const tiling * t, long y, long x)
+{
+  if (y >= t->rows || x >= t->cols || !n->population)
+    return;
+
+  if (!n->level)
+  {
+    PLANE_ROW(t->space, t->stride, y + t->halo)[x + t->halo] = 1;
+    return;
+  }
+
+  long half = 1L << (n->level - 1);
+  flatten(n->nw, t, y, x);
+  flatten(n->ne, t, y, x + half);
+  flatten(n->sw, t, y + half, x);
+  flatten(n->se, t, y + half, x + half);
+}
+
+static void clear_board(const tiling * t)
+{
+  for (int y = 0; y < t->rows; ++y)
+    memset(PLANE_ROW(t->space, t->stride, y + t->halo) + t->halo, 0, t->cols);
+}
+
+static int log2_ceil(long v)
+{
+  int l = 0;
+  while ((1L << l) < v)
+    ++l;
+  return l;
+}
+
+/*
+ * Universe for power-of-two boards: the square power-of-two tiling of the
+ * board, at level `m`.
+ * Jumps 2^k generations on a window of level L = max(m+1, k+2) centered on
+ * the universe. For L = m+1 the window is the universe shifted by half its
+ * size, otherwise an aligned tiling of the universe.
+ */
+static node * jump_universe(node * u, int m, int k)
+{
+  int level = m + 1 > k + 2 ? m + 1 : k + 2;
+  node * w;
+
+  if (level == m + 1)
+  {
+    node * q = find_node(u->se, u->sw, u->ne, u->nw);
+    w = find_node(q, q, q, q);
+  }
+  else
+  {
+    w = u;
+    while (w->level < level)
+      w = find_node(w, w, w, w);
+  }
+
+  node * r = step(w, k);
+  while (r->level > m)
+    r = r->nw;
+  return r;
+}
+
+/*
+ * Jump for other boards: the window is rebuilt from the board, with its
+ * center on the board origin
+ */
+static void jump_board(const tiling * t, int m, int k)
+{
+  tiling wt = *t;
+  wt.oy = wt.ox = -(1 << (m - 1));
+
+  node * w = build(&wt, m + 1, 0, 0);
+  node * r = step(w, k);
+
+  clear_board(t);
+  flatten(r, t, 0, 0);
+  check_cache(w);
+}
+
+int main(int argc, char **argv)
+{
+  state s;
+
+  /* input parameters */
+  char * filename;
+  char * output_filename;
+  int gsize[2];
+  int max_gens;
+  int jump;
+  long max_nodes;
+
+  if (!parse_hashlife_arguments(argc, argv, &filename, gsize, &max_gens, &output_filename,
+                                &jump, &max_nodes))
+  {
+    printf("Usage: %s [-j JUMP] [-m NODES] FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]\n", argv[0]);
+    printf("  -j JUMP   log2 of the generations per jump (default: largest that fits GENS)\n");
+    printf("  -m NODES  node cache size triggering garbage collection (default: %ld)\n",
+           DEFAULT_MAX_NODES);
+    return ERROR_ARGS;
+  }
+
+  alloc_state(&s, gsize[ROWS], gsize[COLS], WITH_HALO);
+
+  FILE * ifile = fopen(filename, "r");
+  if (!ifile)
+  {
+    fprintf(stderr, "Error: %s %s\n", strerror(errno), filename);
+    exit(errno);
+  }
+
+  for (int y=s.halo; y<s.rows+s.halo; ++y)
+  {
+    int readcnt = fread(SPACE_ROW(&s, y)+s.halo, sizeof(char), s.cols, ifile);
+    if (readcnt != s.cols) {
+        fprintf(stderr,
+                "ERROR, syntax error in '%s'. fread returned %d instead of %d\n",
+                filename, readcnt, s.cols);
+        fprintf(stderr,
+                "       check if size (%d, %d) is correct for '%s'\n",
+                s.rows, s.cols, filename);
+        exit(IOERR);
+    }
+  }
+  fclose(ifile);
+
+  init_cache(max_nodes);
+
+  tiling board = {s.space, s.stride, s.halo, s.rows, s.cols, 0, 0};
+  int pow2 = !(s.rows & (s.rows - 1)) && !(s.cols & (s.cols - 1));
+  int m = log2_ceil(s.rows > s.cols ? s.rows : s.cols);
+  int max_jump = pow2 ? MAX_LEVEL - 2 : m - 1;
+  long remaining = max_gens;
+
+  if (m < 2)
+  {
+    fprintf(stderr, "Error: board must be at least 3x3\n");
+    exit(ERROR_ARGS);
+  }
+
+  if (jump < 0)
+    jump = max_gens > 0 ? log2_ceil(max_gens + 1L) - 1 : 0;
+  if (jump > max_jump)
+  {
+    printf("Jumps limited to 2^%d generations for this board size\n", max_jump);
+    jump = max_jump;
+  }
+
+  node * universe = pow2 ? build(&board, m, 0, 0) : NULL;
+
+  /* jumps of 2^jump generations, then the remaining ones */
+  for (int k = jump; k >= 0; --k)
+  {
+    while (remaining >= (1L << k))
+    {
+      if (pow2)
+      {
+        universe = jump_universe(universe, m, k);
+        check_cache(universe);
+      }
+      else
+      {
+        jump_board(&board, m, k);
+      }
+      remaining -= 1L << k;
+      s.generation += 1L << k;
+    }
+  }
+
+  if (pow2)
+  {
+    clear_board(&board);
+    flatten(universe, &board, 0, 0);
+  }
+
+  long population = 0;
+  for (int y = s.halo; y < s.rows + s.halo; ++y)
+    for (int x = s.halo; x < s.cols + s.halo; ++x)
+      population += SPACE(&s, y, x);
+
+  printf("\nPopulation after %ld generations: %ld\n", s.generation, population);
+  printf("  Node cache: %zu nodes, %ld garbage collections\n", cache.count, cache.collections);
+
+  write_bmp(output_filename, &s);
+  printf("\nFinal state dumped to %s\n", output_filename);
+
+  print_state(&s, "output", gsize);
+
+  free_state(&s);
+}
+
+int parse_hashlife_arguments(int argc, char *argv[], char **filename, int *gsize, int *max_gens,
+                             char **output_filename, int * jump, long * max_nodes)
+{
+  options opts;
+  int opt;
+
+  *jump = -1;
+  *max_nodes = DEFAULT_MAX_NODES;
+
+  /* '+': stop at the first positional argument */
+  while ((opt = getopt(argc, argv, "+j:m:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'j':
+        *jump = atoi(optarg);
+        if (*jump < 0)
+          return 0;
+        break;
+      case 'm':
+        *max_nodes = atol(optarg);
+        if (*max_nodes <= 0)
+          return 0;
+        break;
+      default:
+        return 0;
+    }
+  }
+
+  /* positional arguments, as for the other versions */
+  argc -= optind - 1;
+  argv += optind - 1;
+  optind = 1;
+  return parse_arguments(argc, argv, filename, gsize, max_gens, output_filename, &opts);
+}
+
+void print_state(state * s, const char * filename, int *gsize)
+{
+  // This function writes the space of state "s" to a file
+  // The output file must be also a valid input file
+  // If GoL is run with '0' iterations, the output file should be equal to input file
+  FILE * ofile = fopen(filename, "w");
+  int halo = s->halo;
+
+  for (int y = halo; y < gsize[ROWS] + halo; ++y) {
+    fwrite(SPACE_ROW(s, y)+halo, sizeof(char), gsize[COLS], ofile);
+  }
+
+  fclose(ofile);
+}
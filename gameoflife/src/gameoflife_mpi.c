@@ -1,18 +1,31 @@
 /*
- * Game of Life (sequential)
+ * Game of Life (MPI)
  *
  * code derived from rosettacode.org
  *
  * Usage:
- *  ./gameoflife_seq FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]
+ *  ./gameoflife_mpi [-k KERNEL] [-i ISA] [-T TILE] [-t THREADS] [-S SCHEDULE] [-b BLOCK] [-r RULE] [-c WINDOW] [-e] [-a] [-d DEPTH] [-x MODE] FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]
  *
+ *  KERNEL is the evolve kernel (e.g., simd, byte, packed)
+ *  ISA is the instruction set for the simd kernel (e.g., auto, avx2, scalar)
+ *  TILE is the tile edge for the tiles kernel
+ *  THREADS is the number of evolve threads per process
+ *  SCHEDULE is the row strips scheduling (static or dynamic[,HEIGHT])
+ *  BLOCK is the column block width (auto, or 0 for full rows)
+ *  RULE is the Life-like (e.g., B36/S23) or Larger than Life rule
+ *  WINDOW is the number of generations searched for cycles
+ *  -e stops once a cycle is found, skipping the remaining whole cycles
+ *  -a picks the fastest kernel, tile and threads for the local boards
+ *  DEPTH is the halo depth, i.e., generations computed per halo exchange
+ *  MODE is the halo exchange (e.g., overlap, persistent, neighbor, fence,
+ *       pscw, notify, blocking)
  *  FILENAME is the input binary file containing the starting state
  *  ROWS/COLS is the size of the starting state
  *  GENS is the number of generations (0 for no limit)
  *  OUTPUT_BMPFILE is the picture of the final state
  *
  * Run with default test matrix:
- *  ./gameoflife_seq
+ *  ./gameoflife_mpi
  *
  */
 #include <stdio.h>
@@ -26,8 +39,6 @@
 
 #include "gol_common.h"
 
-#define WITH_HALO 1
-
 #define UP    0
 #define DOWN  1
 #define LEFT  2
@@ -39,6 +50,17 @@
 
 #define IOERR 1
 
+#define MIN(a,b) (a<b?a:b)
+#define MAX(a,b) (a>b?a:b)
+
+/* Moore neighbors, as (rows, cols) offsets; the opposite of d is 7-d */
+#define HALO_DIRS 8
+static const int halo_dir[HALO_DIRS][2] = {{-1,-1}, {-1,0}, {-1,1}, {0,-1}, {0,1}, {1,-1}, {1,0}, {1,1}};
+/* one region per neighbor, as counts and graph weights */
+static const int halo_ones[HALO_DIRS] = {1, 1, 1, 1, 1, 1, 1, 1};
+
+typedef struct exchange_mode exchange_mode;
+
 typedef struct {
   int rank;        /* mpi rank */
   int size;        /* mpi size */
@@ -46,45 +68,130 @@ typedef struct {
   int dim[2];      /* mpi proc grid dimensions */
   int coord[2];    /* mpi proc grid coordinate */
   MPI_Comm comm;   /* mpi intercommunicator */
+  long exchanges;  /* halo exchanges performed */
+  MPI_Request cycle_req; /* reduction of a generation signature in flight */
+  long cycle_gen;        /* generation of the signature in flight */
+  long local_sig[2];     /* local changed cells and population */
+  long global_sig[2];    /* global changed cells and population */
+  const exchange_mode * mode;           /* halo exchange in use */
+  int around[HALO_DIRS];                /* ranks of the Moore neighbors */
+  MPI_Datatype halo_type[HALO_DIRS];    /* region exchanged with each neighbor */
+  MPI_Aint send_disp[HALO_DIRS];        /* bytes from `space` to the region sent */
+  MPI_Aint recv_disp[HALO_DIRS];        /* bytes from `space` to the halo received */
+  MPI_Request halo_req[2*HALO_DIRS];    /* receives, then sends in flight */
+  char * plane[2];                      /* the planes `space` alternates between */
+  MPI_Request persist_req[2][2*HALO_DIRS]; /* persistent requests of each plane */
+  MPI_Comm graph;                       /* Moore neighborhood, sources in reverse */
+  MPI_Datatype graph_type[HALO_DIRS];   /* halo of each source of the graph */
+  MPI_Aint graph_disp[HALO_DIRS];       /* bytes from `space` to those halos */
+#if MPI_VERSION >= 4
+  MPI_Request graph_req[2];             /* persistent collective of each plane */
+#endif
+  MPI_Win win;                          /* both planes, for one-sided exchanges */
+  MPI_Group group;                      /* the distinct Moore neighbors */
+  MPI_Aint target_disp[2][HALO_DIRS];   /* window offset of the halo at each neighbor */
+  MPI_Win flag_win;                     /* notification counters, see start_notify */
+  long * flags;
+  long epoch;                           /* exchanges started */
+  double halo_time;      /* time spent in halo exchange calls */
+  double halo_max;       /* longest halo exchange */
+  double interior_time;  /* interior computed while halos were in flight */
 } parallel_state;
 
-void game(state * s, int max_gens, parallel_state * mpi);
+/*
+ * A halo exchange mode fills the halos of `space` from the neighbors. Modes
+ * with `finish` return from `start` with the exchange in flight, and the
+ * interior of the next generation is computed before `finish` is called
+ */
+struct exchange_mode {
+  const char * name;
+  void (*init)(state * s, parallel_state * mpi);    /* set up, once (optional) */
+  void (*start)(state * s, parallel_state * mpi);   /* start the exchange */
+  void (*finish)(state * s, parallel_state * mpi);  /* complete it (optional) */
+  void (*release)(state * s, parallel_state * mpi); /* tear down (optional) */
+};
+
+void game(state * s, int max_gens, parallel_state * mpi, cycle_state * cycle);
+int check_cycle(state * s, int max_gens, parallel_state * mpi, cycle_state * cycle, long changes);
 void swap_halo(state * s, parallel_state * mpi);
+void halo_regions(state * s, parallel_state * mpi);
+void start_overlap(state * s, parallel_state * mpi);
+void finish_overlap(state * s, parallel_state * mpi);
+void init_persistent(state * s, parallel_state * mpi);
+void start_persistent(state * s, parallel_state * mpi);
+void finish_persistent(state * s, parallel_state * mpi);
+void free_persistent(state * s, parallel_state * mpi);
+void init_neighbor(state * s, parallel_state * mpi);
+void start_neighbor(state * s, parallel_state * mpi);
+void finish_neighbor(state * s, parallel_state * mpi);
+void free_neighbor(state * s, parallel_state * mpi);
+void init_rma(state * s, parallel_state * mpi);
+void start_fence(state * s, parallel_state * mpi);
+void finish_fence(state * s, parallel_state * mpi);
+void start_pscw(state * s, parallel_state * mpi);
+void finish_pscw(state * s, parallel_state * mpi);
+void free_rma(state * s, parallel_state * mpi);
+void init_notify(state * s, parallel_state * mpi);
+void start_notify(state * s, parallel_state * mpi);
+void finish_notify(state * s, parallel_state * mpi);
+void free_notify(state * s, parallel_state * mpi);
 int read_input(state * s, const char * filename, const int *gsize, parallel_state * mpi);
 void print_state(state * s, const char * filename, int *gsizes, parallel_state * mpi);
 
 MPI_Datatype mpi_lcontig_t, mpi_lrow_t, mpi_lcol_t,
              mpi_scontig_t,  mpi_sblock_t;
 
+static const exchange_mode exchange_modes[] = {
+  {"overlap",    NULL,            start_overlap,    finish_overlap,    NULL},
+  {"persistent", init_persistent, start_persistent, finish_persistent, free_persistent},
+  {"neighbor",   init_neighbor,   start_neighbor,   finish_neighbor,   free_neighbor},
+  {"fence",      init_rma,        start_fence,      finish_fence,      free_rma},
+  {"pscw",       init_rma,        start_pscw,       finish_pscw,       free_rma},
+  {"notify",     init_notify,     start_notify,     finish_notify,     free_notify},
+  {"blocking",   NULL,            swap_halo,        NULL,              NULL},
+  {NULL, NULL, NULL, NULL, NULL}
+};
+
 int main(int argc, char **argv)
 {
-  MPI_Init(&argc, &argv);
+  /* evolve threads never call MPI */
+  int thread_level;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_level);
 
   state s;
+  cycle_state cycle;
 
   /* input parameters */
   char * filename;
   char * output_filename;
   int gsize[2];
   int max_gens;
+  options opts;
 
   /* MPI */
   parallel_state mpi;
-  int lsize[2],
+  int lsize[2], halo,
       warp_around[2] = {1,1}; /* cyclic game space? {vertical, horizontal} */
 
   /* runtimes */
   double s_time, i_time, c0_time, c1_time, e_time;
 
-  if (!parse_arguments(argc, argv, &filename, gsize, &max_gens, &output_filename))
+  if (!parse_arguments(argc, argv, &filename, gsize, &max_gens, &output_filename, &opts))
   {
-    printf("Usage: %s FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]\n", argv[0]);
+    print_usage(argv[0]);
     return ERROR_ARGS;
   }
 
   MPI_Comm_rank(MPI_COMM_WORLD, &mpi.rank);
   MPI_Comm_size(MPI_COMM_WORLD, &mpi.size);
 
+  if (thread_level < MPI_THREAD_FUNNELED && opts.threads != 1)
+  {
+    if (!mpi.rank)
+      fprintf(stderr, "Warning: MPI library without thread support, running a single thread\n");
+    opts.threads = 1;
+  }
+
   /* auto-set 2D processors grid */
   mpi.dim[COLS] = (int) floor(sqrt(mpi.size));
   while (mpi.size % mpi.dim[COLS])
@@ -121,17 +228,29 @@ int main(int argc, char **argv)
   lsize[ROWS] = gsize[ROWS]/mpi.dim[ROWS];
   lsize[COLS] = gsize[COLS]/mpi.dim[COLS];
 
-  alloc_state(&s, lsize[ROWS], lsize[COLS], WITH_HALO);
+  /* each generation per exchange takes a ring as wide as the radius */
+  halo = opts.depth * opts.radius;
+  if (halo > lsize[ROWS] || halo > lsize[COLS])
+  {
+    if (mpi.rank == 0)
+      printf("Error: Halo width %d is larger than the local size %d x %d\n",
+             halo, lsize[ROWS], lsize[COLS]);
+    MPI_Finalize();
+    return ERROR_ARGS;
+  }
+
+  alloc_state(&s, lsize[ROWS], lsize[COLS], halo);
 
   /* create extended block datatypes */
   MPI_Type_contiguous(s.cols, MPI_CHAR, &mpi_lcontig_t);
-  MPI_Type_create_resized(mpi_lcontig_t, /* input datatype */
-                          0,             /* new lower bound */
-                          s.cols+2,      /* new extent */
-                          &mpi_lrow_t);  /* new datatype (output) */
+  MPI_Type_create_resized(mpi_lcontig_t,    /* input datatype */
+                          0,                /* new lower bound */
+                          s.stride,         /* new extent */
+                          &mpi_lrow_t);     /* new datatype (output) */
   MPI_Type_commit(&mpi_lrow_t);
 
-  MPI_Type_vector(s.rows, 1, s.cols+2, MPI_CHAR, &mpi_lcol_t);
+  /* halo columns span the halo rows too, so that corners are forwarded */
+  MPI_Type_vector(s.rows+2*s.halo, s.halo, s.stride, MPI_CHAR, &mpi_lcol_t);
   MPI_Type_commit(&mpi_lcol_t);
 
   MPI_Type_vector(lsize[ROWS], lsize[COLS], gsize[COLS], MPI_CHAR, &mpi_scontig_t);
@@ -141,6 +260,19 @@ int main(int argc, char **argv)
                           &mpi_sblock_t); /* new datatype (output) */
   MPI_Type_commit(&mpi_sblock_t);
 
+  /* halo exchange */
+  halo_regions(&s, &mpi);
+  for (mpi.mode = exchange_modes; mpi.mode->name && strcmp(mpi.mode->name, opts.exchange); ++mpi.mode);
+  if (!mpi.mode->name)
+  {
+    if (mpi.rank == 0)
+      fprintf(stderr, "Error: unknown halo exchange mode '%s'\n", opts.exchange);
+    MPI_Finalize();
+    return ERROR_ARGS;
+  }
+  if (mpi.mode->init)
+    mpi.mode->init(&s, &mpi);
+
   /* print grid configuration */
   for (int p=0; p<mpi.size; ++p)
   {
@@ -164,9 +296,24 @@ int main(int argc, char **argv)
   if (read_input(&s, filename, gsize, &mpi) != MPI_SUCCESS)
     MPI_Abort(MPI_COMM_WORLD, IOERR);
 
+  if (opts.autotune && !autotune(&s, &opts))
+  {
+    if (!mpi.rank)
+      fprintf(stderr, "Error: no kernel can run this board\n");
+    MPI_Abort(MPI_COMM_WORLD, ERROR_ARGS);
+  }
+
+  if (!set_kernel(&s, &opts))
+  {
+    if (!mpi.rank)
+      fprintf(stderr, "Error: cannot use kernel '%s'\n", opts.kernel);
+    MPI_Abort(MPI_COMM_WORLD, ERROR_ARGS);
+  }
+
   i_time = MPI_Wtime();
 
-  game(&s, max_gens, &mpi);
+  cycle_init(&cycle, opts.cycle_window);
+  game(&s, max_gens, &mpi, &cycle);
 
   c0_time = MPI_Wtime();
 
@@ -176,6 +323,7 @@ int main(int argc, char **argv)
     {
       printf("Process (%d,%d): Local Checksum %ld\n",
              mpi.coord[ROWS], mpi.coord[COLS], s.checksum);
+      print_stats(&s);
     }
     MPI_Barrier(MPI_COMM_WORLD);
   }
@@ -184,12 +332,21 @@ int main(int argc, char **argv)
   MPI_Reduce(mpi.rank?&s.checksum:MPI_IN_PLACE, &s.checksum, 1,
                MPI_LONG, MPI_SUM, 0,
                MPI_COMM_WORLD);
+  MPI_Reduce(mpi.rank?&s.population:MPI_IN_PLACE, &s.population, 1,
+               MPI_LONG, MPI_SUM, 0,
+               MPI_COMM_WORLD);
 
   if (!mpi.rank)
+  {
     printf("\nGlobal Checksum after %ld generations: %ld\n", s.generation, s.checksum);
+    printf("Global Population: %ld\n", s.population);
+    cycle_report(&cycle);
+  }
 
   c1_time = MPI_Wtime();
 
+  sync_state(&s);
+
   /* draw the final space state in a bmp image */
   write_bmp_mpi(output_filename, &s, gsize, mpi.dim, mpi.comm);
   if (!mpi.rank)
@@ -200,32 +357,133 @@ int main(int argc, char **argv)
 
   e_time = MPI_Wtime();
 
+  /* the slowest process sets the pace */
+  MPI_Reduce(mpi.rank ? &mpi.halo_time : MPI_IN_PLACE, &mpi.halo_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(mpi.rank ? &mpi.halo_max : MPI_IN_PLACE, &mpi.halo_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(mpi.rank ? &mpi.interior_time : MPI_IN_PLACE, &mpi.interior_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
   if (!mpi.rank)
   {
     printf("\nRuntimes:\n");
     printf("  Input: %lf seconds\n", i_time - s_time);
-    printf("  Computation: %lf seconds\n", c0_time - i_time);
+    printf("  Computation: %lf seconds (%.3e cells/s)\n", c0_time - i_time,
+           (double) gsize[ROWS] * gsize[COLS] * s.generation / (c0_time - i_time));
     printf("  Output: %lf seconds\n", e_time - c1_time);
+    printf("  Halo exchanges: %ld (depth %d, %s)\n", mpi.exchanges, opts.depth, mpi.mode->name);
+    printf("  Halo wait: %lf seconds (%.2f us per generation, longest exchange %.2f us)\n",
+           mpi.halo_time, s.generation ? 1e6 * mpi.halo_time / s.generation : 0.0, 1e6 * mpi.halo_max);
+    if (mpi.interior_time > 0)
+      printf("  Interior computed during exchanges: %lf seconds\n", mpi.interior_time);
   }
+  if (mpi.mode->release)
+    mpi.mode->release(&s, &mpi);
+  cycle_free(&cycle);
   free_state(&s);
 
   MPI_Finalize();
 }
 
-void game(state * s, int max_gens, parallel_state * mpi)
+void game(state * s, int max_gens, parallel_state * mpi, cycle_state * cycle)
 {
   long sum_gendiff = 0.;
 
+  mpi->exchanges = 0;
+  mpi->cycle_req = MPI_REQUEST_NULL;
+  mpi->halo_time = mpi->halo_max = mpi->interior_time = 0;
+
   //show(s, 0); /* This line prints to stdout the inital state */
   while (s->generation < max_gens)
   {
     assert(s->halo);
 
-    swap_halo(s, mpi);
+    /*
+     * A halo of depth d allows computing d generations per exchange,
+     * shrinking the valid halo ring by the neighborhood radius per generation
+     */
+    int gens = MIN(s->halo / s->radius, max_gens - s->generation);
+
+    double t = MPI_Wtime(), halo_time;
+    mpi->mode->start(s, mpi);
+    halo_time = MPI_Wtime() - t;
+    ++mpi->exchanges;
 
     /* evolve */
-    sum_gendiff += evolve(s);
+    for (int g = gens-1; g >= 0; --g)
+    {
+      long changes;
+
+      s->margin = g * s->radius;
+      if (g == gens-1 && mpi->mode->finish)
+      {
+        /* the interior does not read the halos: compute it while they arrive */
+        int overlap = s->kernel->parts;
+        if (overlap)
+        {
+          t = MPI_Wtime();
+          evolve_interior(s);
+          mpi->interior_time += MPI_Wtime() - t;
+        }
+        t = MPI_Wtime();
+        mpi->mode->finish(s, mpi);
+        halo_time += MPI_Wtime() - t;
+        changes = overlap ? evolve_boundary(s) : evolve(s);
+      }
+      else
+        changes = evolve(s);
+      sum_gendiff += changes;
+      if (g == gens-1)
+      {
+        mpi->halo_time += halo_time;
+        mpi->halo_max = MAX(mpi->halo_max, halo_time);
+      }
+
+      /* after skipping cycles, halos are exchanged again */
+      if (cycle->window && check_cycle(s, max_gens, mpi, cycle, changes))
+        break;
+    }
+    s->margin = 0;
+  }
+
+  if (mpi->cycle_req != MPI_REQUEST_NULL)
+    MPI_Wait(&mpi->cycle_req, MPI_STATUS_IGNORE);
+}
+
+/*
+ * Cycle detection. The signature of a generation is reduced while the next
+ * one is computed, and checked one generation late; all processes take the
+ * same decisions from the global signatures and board hashes.
+ * Returns 1 if whole cycles were skipped
+ */
+int check_cycle(state * s, int max_gens, parallel_state * mpi, cycle_state * cycle, long changes)
+{
+  if (mpi->cycle_req != MPI_REQUEST_NULL)
+  {
+    MPI_Wait(&mpi->cycle_req, MPI_STATUS_IGNORE);
+    if (cycle_update(cycle, mpi->cycle_gen, mpi->global_sig[0], mpi->global_sig[1], mpi->local_sig[0]) &&
+        cycle_hash_due(cycle, s->generation))
+    {
+      uint64_t hash = board_hash(s, (long) mpi->coord[ROWS] * s->rows, (long) mpi->coord[COLS] * s->cols,
+                                 (long) mpi->dim[COLS] * s->cols);
+      MPI_Allreduce(MPI_IN_PLACE, &hash, 1, MPI_UINT64_T, MPI_SUM, mpi->comm);
+      if (cycle_confirm(cycle, s->generation, hash) && s->opts->early_stop)
+      {
+        /* skip the remaining whole cycles, then compute the rest */
+        long skip = (max_gens - s->generation) / cycle->period * cycle->period;
+        s->checksum += cycle_skip(cycle, skip);
+        s->generation += skip;
+        return 1;
+      }
+    }
+  }
+
+  if (cycle->found < 0)
+  {
+    mpi->local_sig[0] = changes;
+    mpi->local_sig[1] = s->population;
+    mpi->cycle_gen = s->generation;
+    MPI_Iallreduce(mpi->local_sig, mpi->global_sig, 2, MPI_LONG, MPI_SUM, mpi->comm, &mpi->cycle_req);
   }
+  return 0;
 }
 
 /*
@@ -233,37 +491,345 @@ void game(state * s, int max_gens, parallel_state * mpi)
  */
 void swap_halo(state * s, parallel_state * mpi)
 {
-  //TODO: Replace this function body with MPI RMA
-  
-  MPI_Request req0, req1;
-  
+  int h = s->halo;
+  MPI_Request req[4];
+
   /* Communicate in y-direction */
 
-  MPI_Isend(s->space[s->rows]+1, s->cols, MPI_CHAR, mpi->neighbor[DOWN], UP, mpi->comm, &req0);
-  MPI_Recv(s->space[0]+1, s->cols, MPI_CHAR, mpi->neighbor[UP], UP, mpi->comm, MPI_STATUS_IGNORE);
-  MPI_Isend(s->space[1]+1, s->cols, MPI_CHAR, mpi->neighbor[UP], DOWN, mpi->comm, &req0);
-  MPI_Recv(s->space[s->rows+1]+1, s->cols, MPI_CHAR, mpi->neighbor[DOWN], DOWN, mpi->comm, MPI_STATUS_IGNORE);
+  MPI_Isend(SPACE_ROW(s, s->rows)+h, h, mpi_lrow_t, mpi->neighbor[DOWN], UP, mpi->comm, &req[0]);
+  MPI_Recv(SPACE_ROW(s, 0)+h, h, mpi_lrow_t, mpi->neighbor[UP], UP, mpi->comm, MPI_STATUS_IGNORE);
+  MPI_Isend(SPACE_ROW(s, h)+h, h, mpi_lrow_t, mpi->neighbor[UP], DOWN, mpi->comm, &req[1]);
+  MPI_Recv(SPACE_ROW(s, s->rows+h)+h, h, mpi_lrow_t, mpi->neighbor[DOWN], DOWN, mpi->comm, MPI_STATUS_IGNORE);
+
+  /* Communicate in x-direction, including the halo rows (corners) */
+
+  MPI_Isend(SPACE_ROW(s, 0)+s->cols, 1, mpi_lcol_t, mpi->neighbor[RIGHT], RIGHT, mpi->comm, &req[2]);
+  MPI_Recv(SPACE_ROW(s, 0),           1, mpi_lcol_t, mpi->neighbor[LEFT], RIGHT, mpi->comm, MPI_STATUS_IGNORE);
+  MPI_Isend(SPACE_ROW(s, 0)+h,        1, mpi_lcol_t, mpi->neighbor[LEFT], LEFT, mpi->comm, &req[3]);
+  MPI_Recv(SPACE_ROW(s, 0)+s->cols+h, 1, mpi_lcol_t, mpi->neighbor[RIGHT], LEFT, mpi->comm, MPI_STATUS_IGNORE);
+
+  MPI_Waitall(4, req, MPI_STATUSES_IGNORE);
+}
+
+/*
+ * Regions exchanged with the 8 Moore neighbors: the h-deep bounding rows,
+ * columns and corners of the grid are sent to the neighbor in their
+ * direction, and received into the halo on the opposite side of it
+ */
+void halo_regions(state * s, parallel_state * mpi)
+{
+  int h = s->halo;
+  MPI_Datatype rows, side, corner;
+
+  MPI_Type_contiguous(h, mpi_lrow_t, &rows);
+  MPI_Type_commit(&rows);
+  MPI_Type_vector(s->rows, h, s->stride, MPI_CHAR, &side);
+  MPI_Type_commit(&side);
+  MPI_Type_vector(h, h, s->stride, MPI_CHAR, &corner);
+  MPI_Type_commit(&corner);
+
+  mpi->plane[0] = s->space;
+  mpi->plane[1] = s->next;
+
+  for (int d = 0; d < HALO_DIRS; ++d)
+  {
+    int dy = halo_dir[d][0], dx = halo_dir[d][1],
+        coord[2] = {mpi->coord[ROWS] + dy, mpi->coord[COLS] + dx};
+
+    MPI_Cart_rank(mpi->comm, coord, &mpi->around[d]);
+    mpi->halo_type[d] = !dy ? side : !dx ? rows : corner;
+    mpi->send_disp[d] = (MPI_Aint) (dy < 0 ? h : dy > 0 ? s->rows : h) * s->stride +
+                        (dx < 0 ? h : dx > 0 ? s->cols : h);
+    mpi->recv_disp[d] = (MPI_Aint) (dy < 0 ? 0 : dy > 0 ? s->rows+h : h) * s->stride +
+                        (dx < 0 ? 0 : dx > 0 ? s->cols+h : h);
+  }
+}
+
+/*
+ * Nonblocking exchange with the 8 neighbors, so that no corner has to be
+ * forwarded. Messages are tagged with the direction they are sent to
+ */
+void start_overlap(state * s, parallel_state * mpi)
+{
+  for (int d = 0; d < HALO_DIRS; ++d)
+    MPI_Irecv(s->space + mpi->recv_disp[d], 1, mpi->halo_type[d], mpi->around[d],
+              HALO_DIRS-1 - d, mpi->comm, &mpi->halo_req[d]);
+  for (int d = 0; d < HALO_DIRS; ++d)
+    MPI_Isend(s->space + mpi->send_disp[d], 1, mpi->halo_type[d], mpi->around[d],
+              d, mpi->comm, &mpi->halo_req[HALO_DIRS + d]);
+}
+
+void finish_overlap(state * s, parallel_state * mpi)
+{
+  MPI_Waitall(2*HALO_DIRS, mpi->halo_req, MPI_STATUSES_IGNORE);
+}
+
+/*
+ * The overlap exchange with persistent requests, set up once for each plane
+ */
+void init_persistent(state * s, parallel_state * mpi)
+{
+  for (int p = 0; p < 2; ++p)
+  {
+    char * plane = mpi->plane[p];
+    MPI_Request * req = mpi->persist_req[p];
+
+    for (int d = 0; d < HALO_DIRS; ++d)
+    {
+      MPI_Recv_init(plane + mpi->recv_disp[d], 1, mpi->halo_type[d], mpi->around[d],
+                    HALO_DIRS-1 - d, mpi->comm, &req[d]);
+      MPI_Send_init(plane + mpi->send_disp[d], 1, mpi->halo_type[d], mpi->around[d],
+                    d, mpi->comm, &req[HALO_DIRS + d]);
+    }
+  }
+}
+
+static MPI_Request * persistent_requests(state * s, parallel_state * mpi)
+{
+  return mpi->persist_req[s->space == mpi->plane[1]];
+}
+
+void start_persistent(state * s, parallel_state * mpi)
+{
+  MPI_Startall(2*HALO_DIRS, persistent_requests(s, mpi));
+}
+
+void finish_persistent(state * s, parallel_state * mpi)
+{
+  MPI_Waitall(2*HALO_DIRS, persistent_requests(s, mpi), MPI_STATUSES_IGNORE);
+}
+
+void free_persistent(state * s, parallel_state * mpi)
+{
+  for (int p = 0; p < 2; ++p)
+    for (int i = 0; i < 2*HALO_DIRS; ++i)
+      MPI_Request_free(&mpi->persist_req[p][i]);
+}
+
+/*
+ * The 8 regions exchanged by a single neighborhood collective over a graph
+ * of the Moore neighbors. A rank may be the neighbor in several directions
+ * (e.g., with 2 ranks per dimension), and then the blocks sent to it are
+ * matched with the blocks it receives in order. Sources are listed in
+ * reverse direction order, so that the block sent in direction d lands in
+ * the halo facing back, 7-d, at its destination
+ */
+void init_neighbor(state * s, parallel_state * mpi)
+{
+  int sources[HALO_DIRS];
+
+  for (int d = 0; d < HALO_DIRS; ++d)
+  {
+    sources[d] = mpi->around[HALO_DIRS-1 - d];
+    mpi->graph_type[d] = mpi->halo_type[HALO_DIRS-1 - d];
+    mpi->graph_disp[d] = mpi->recv_disp[HALO_DIRS-1 - d];
+  }
+  MPI_Dist_graph_create_adjacent(mpi->comm, HALO_DIRS, sources, halo_ones,
+                                 HALO_DIRS, mpi->around, halo_ones,
+                                 MPI_INFO_NULL, 0, &mpi->graph);
+
+#if MPI_VERSION >= 4
+  for (int p = 0; p < 2; ++p)
+    MPI_Neighbor_alltoallw_init(mpi->plane[p], halo_ones, mpi->send_disp, mpi->halo_type,
+                                mpi->plane[p], halo_ones, mpi->graph_disp, mpi->graph_type,
+                                mpi->graph, MPI_INFO_NULL, &mpi->graph_req[p]);
+#endif
+}
+
+void start_neighbor(state * s, parallel_state * mpi)
+{
+#if MPI_VERSION >= 4
+  MPI_Start(&mpi->graph_req[s->space == mpi->plane[1]]);
+#else
+  MPI_Ineighbor_alltoallw(s->space, halo_ones, mpi->send_disp, mpi->halo_type,
+                          s->space, halo_ones, mpi->graph_disp, mpi->graph_type,
+                          mpi->graph, &mpi->halo_req[0]);
+#endif
+}
+
+void finish_neighbor(state * s, parallel_state * mpi)
+{
+#if MPI_VERSION >= 4
+  MPI_Wait(&mpi->graph_req[s->space == mpi->plane[1]], MPI_STATUS_IGNORE);
+#else
+  MPI_Wait(&mpi->halo_req[0], MPI_STATUS_IGNORE);
+#endif
+}
+
+void free_neighbor(state * s, parallel_state * mpi)
+{
+#if MPI_VERSION >= 4
+  MPI_Request_free(&mpi->graph_req[0]);
+  MPI_Request_free(&mpi->graph_req[1]);
+#endif
+  MPI_Comm_free(&mpi->graph);
+}
+
+/*
+ * One-sided exchanges: both planes are exposed in a window, and the regions
+ * are put straight into the halos of the neighbors. Planes are aligned in
+ * the memory block of each rank on their own, so the offset of the halos
+ * in the window of every neighbor is gathered beforehand
+ */
+void init_rma(state * s, parallel_state * mpi)
+{
+  MPI_Aint (*offset)[2] = malloc(mpi->size * sizeof(*offset));
+  MPI_Aint size;
+  MPI_Group all;
+  int ranks[HALO_DIRS], n = 0;
+
+  offset[mpi->rank][0] = mpi->plane[0] - s->planes;
+  offset[mpi->rank][1] = mpi->plane[1] - s->planes;
+  MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, offset, 2, MPI_AINT, mpi->comm);
+  for (int p = 0; p < 2; ++p)
+    for (int d = 0; d < HALO_DIRS; ++d)
+      mpi->target_disp[p][d] = offset[mpi->around[d]][p] + mpi->recv_disp[HALO_DIRS-1 - d];
+  free(offset);
+
+  /* the block allocated by alloc_state */
+  size = 2 * (mpi->plane[1] - mpi->plane[0]) + ALIGNMENT;
+  MPI_Win_create(s->planes, size, 1, MPI_INFO_NULL, mpi->comm, &mpi->win);
+
+  /* a neighbor in several directions is listed once */
+  for (int d = 0; d < HALO_DIRS; ++d)
+  {
+    int i = 0;
+    while (i < n && ranks[i] != mpi->around[d])
+      ++i;
+    if (i == n)
+      ranks[n++] = mpi->around[d];
+  }
+  MPI_Comm_group(mpi->comm, &all);
+  MPI_Group_incl(all, n, ranks, &mpi->group);
+  MPI_Group_free(&all);
+}
+
+/* put the bounding regions into the halos of the current plane of the neighbors */
+static void put_halos(state * s, parallel_state * mpi)
+{
+  int p = s->space == mpi->plane[1];
+
+  for (int d = 0; d < HALO_DIRS; ++d)
+    MPI_Put(s->space + mpi->send_disp[d], 1, mpi->halo_type[d], mpi->around[d],
+            mpi->target_disp[p][d], 1, mpi->halo_type[d], mpi->win);
+}
+
+/*
+ * Fence epochs: puts reach a neighbor once it is past its opening fence,
+ * i.e., done with the previous generations
+ */
+void start_fence(state * s, parallel_state * mpi)
+{
+  MPI_Win_fence(MPI_MODE_NOPRECEDE, mpi->win);
+  put_halos(s, mpi);
+}
+
+void finish_fence(state * s, parallel_state * mpi)
+{
+  MPI_Win_fence(MPI_MODE_NOSUCCEED, mpi->win);
+}
+
+/*
+ * Post-start-complete-wait: the same, but synchronizing with the neighbors
+ * only instead of every rank
+ */
+void start_pscw(state * s, parallel_state * mpi)
+{
+  MPI_Win_post(mpi->group, 0, mpi->win);
+  MPI_Win_start(mpi->group, 0, mpi->win);
+  put_halos(s, mpi);
+}
 
-  /* Communicate in x-direction */
+void finish_pscw(state * s, parallel_state * mpi)
+{
+  MPI_Win_complete(mpi->win);
+  MPI_Win_wait(mpi->win);
+}
 
-  MPI_Isend(s->space[1]+s->cols, 1, mpi_lcol_t, mpi->neighbor[RIGHT], RIGHT, mpi->comm, &req0);
-  MPI_Recv(s->space[1],           1, mpi_lcol_t, mpi->neighbor[LEFT], RIGHT, mpi->comm, MPI_STATUS_IGNORE);
-  MPI_Isend(s->space[1]+1,         1, mpi_lcol_t, mpi->neighbor[LEFT], LEFT, mpi->comm, &req1);
-  MPI_Recv(s->space[1]+s->cols+1, 1, mpi_lcol_t, mpi->neighbor[RIGHT], LEFT, mpi->comm, MPI_STATUS_IGNORE);
+void free_rma(state * s, parallel_state * mpi)
+{
+  MPI_Group_free(&mpi->group);
+  MPI_Win_free(&mpi->win);
+}
 
-  /* Swap corner data in auxiliary rows*/
-  char scornerbuf[4] = {s->space[0][s->cols], s->space[s->rows+1][s->cols], s->space[0][1], s->space[s->rows+1][1]};
-  char rcornerbuf[4];
+/*
+ * Passive-target exchange: the windows stay locked for the whole run, and
+ * every rank only synchronizes with its neighbors through two counters per
+ * direction in a small window of its own. READY(d) counts the exchanges the
+ * neighbor in direction d may start putting into this rank's halos (the
+ * previous generations are done with them), and ARRIVED(d) the exchanges
+ * whose regions from that neighbor are in place.
+ */
+#define READY(d)   (d)
+#define ARRIVED(d) (HALO_DIRS + (d))
 
-  MPI_Isend(scornerbuf, 2, MPI_CHAR, mpi->neighbor[RIGHT], RIGHT, mpi->comm, &req0);
-  MPI_Recv(rcornerbuf, 2, MPI_CHAR, mpi->neighbor[LEFT], RIGHT, mpi->comm, MPI_STATUS_IGNORE);
-  MPI_Isend(scornerbuf+2, 2, MPI_CHAR, mpi->neighbor[LEFT], LEFT, mpi->comm, &req0);
-  MPI_Recv(rcornerbuf+2, 2, MPI_CHAR, mpi->neighbor[RIGHT], LEFT, mpi->comm, MPI_STATUS_IGNORE);
+void init_notify(state * s, parallel_state * mpi)
+{
+  init_rma(s, mpi);
+  MPI_Win_allocate(2*HALO_DIRS * sizeof(long), sizeof(long), MPI_INFO_NULL, mpi->comm,
+                   &mpi->flags, &mpi->flag_win);
+  memset(mpi->flags, 0, 2*HALO_DIRS * sizeof(long));
+  mpi->epoch = 0;
+  MPI_Barrier(mpi->comm);
+
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, mpi->win);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, mpi->flag_win);
+}
 
-  s->space[0][0] = rcornerbuf[0];
-  s->space[s->rows+1][0] = rcornerbuf[1];
-  s->space[0][s->cols+1] = rcornerbuf[2];
-  s->space[s->rows+1][s->cols+1] = rcornerbuf[3];
+/* add one to a counter of every neighbor, in the slot facing this rank */
+static void notify(parallel_state * mpi, int arrived)
+{
+  static const long one = 1;
+
+  for (int d = 0; d < HALO_DIRS; ++d)
+    MPI_Accumulate(&one, 1, MPI_LONG, mpi->around[d],
+                   arrived ? ARRIVED(HALO_DIRS-1 - d) : READY(HALO_DIRS-1 - d),
+                   1, MPI_LONG, MPI_SUM, mpi->flag_win);
+  MPI_Win_flush_all(mpi->flag_win);
+}
+
+/* wait until the counters of every direction reach the current exchange */
+static void wait_notify(parallel_state * mpi, int arrived)
+{
+  for (int d = 0; d < HALO_DIRS; ++d)
+  {
+    long count = 0;
+
+    while (count < mpi->epoch)
+    {
+      MPI_Fetch_and_op(NULL, &count, MPI_LONG, mpi->rank, arrived ? ARRIVED(d) : READY(d),
+                       MPI_NO_OP, mpi->flag_win);
+      MPI_Win_flush(mpi->rank, mpi->flag_win);
+    }
+  }
+}
+
+void start_notify(state * s, parallel_state * mpi)
+{
+  ++mpi->epoch;
+
+  /* the halos of this rank may be overwritten from now on */
+  MPI_Win_sync(mpi->win);
+  notify(mpi, 0);
+
+  wait_notify(mpi, 0);
+  put_halos(s, mpi);
+  MPI_Win_flush_all(mpi->win);
+  notify(mpi, 1);
+}
+
+void finish_notify(state * s, parallel_state * mpi)
+{
+  wait_notify(mpi, 1);
+  MPI_Win_sync(mpi->win);
+}
+
+void free_notify(state * s, parallel_state * mpi)
+{
+  MPI_Win_unlock_all(mpi->flag_win);
+  MPI_Win_unlock_all(mpi->win);
+  MPI_Win_free(&mpi->flag_win);
+  free_rma(s, mpi);
 }
 
 /*
@@ -319,7 +885,7 @@ int read_input(state * s, const char * filename, const int *gsize, parallel_stat
   }
 
   return_val = MPI_Scatterv(mat, counts, disps, mpi_sblock_t,
-                            &s->space[1][1], s->rows, mpi_lrow_t,
+                            &SPACE(s, s->halo, s->halo), s->rows, mpi_lrow_t,
                             0, mpi->comm);
 
   if (mat) free(mat);
@@ -364,7 +930,7 @@ void print_state(state * s, const char * filename, int *gsize, parallel_state *
       }
   }
 
-  return_val = MPI_Gatherv(&s->space[1][1], s->rows, mpi_lrow_t,
+  return_val = MPI_Gatherv(&SPACE(s, s->halo, s->halo), s->rows, mpi_lrow_t,
                            mat, counts, disps, mpi_sblock_t,
                            0, mpi->comm);
 
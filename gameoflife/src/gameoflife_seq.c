@@ -4,8 +4,19 @@
  * code derived from rosettacode.org
  *
  * Usage:
- *  ./gameoflife_seq FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]
+ *  ./gameoflife_seq [-k KERNEL] [-i ISA] [-T TILE] [-t THREADS] [-S SCHEDULE] [-b BLOCK] [-r RULE] [-c WINDOW] [-e] [-a] [-E] FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]
  *
+ *  KERNEL is the evolve kernel (e.g., simd, byte, packed)
+ *  ISA is the instruction set for the simd kernel (e.g., auto, avx2, scalar)
+ *  TILE is the tile edge for the tiles kernel
+ *  THREADS is the number of evolve threads
+ *  SCHEDULE is the row strips scheduling (static or dynamic[,HEIGHT])
+ *  BLOCK is the column block width (auto, or 0 for full rows)
+ *  RULE is the Life-like (e.g., B36/S23) or Larger than Life rule
+ *  WINDOW is the number of generations searched for cycles
+ *  -e stops once a cycle is found, skipping the remaining whole cycles
+ *  -a picks the fastest kernel, tile and threads for the board
+ *  -E evolves the boards of the input files listed in FILENAME together
  *  FILENAME is the input binary file containing the starting state
  *  ROWS/COLS is the size of the starting state
  *  GENS is the number of generations (0 for no limit)
@@ -28,8 +39,6 @@
   #define LIVE 0
 #endif
 
-#define WITH_HALO 1
-
 #define EXIT_OK    0
 #define ERROR_ARGS 1
 
@@ -39,27 +48,43 @@
 
 #define IOERR 1
 
-void game(state * s, int max_gens);
+void game(state * s, int max_gens, cycle_state * cycle);
 void swap_halo(state * s);
 void print_state(state * s, const char * filename, int *gsize);
+int ensemble_game(const char * list, int *gsize, int max_gens, const char * output_filename, options * opts);
 
 int main(int argc, char **argv)
 {
   state s;
+  cycle_state cycle;
 
   /* input parameters */
   char * filename;
   char * output_filename;
   int gsize[2];
   int max_gens;
+  options opts;
+
+  /* runtimes */
+  double s_time, c_time;
 
-  if (!parse_arguments(argc, argv, &filename, gsize, &max_gens, &output_filename))
+  if (!parse_arguments(argc, argv, &filename, gsize, &max_gens, &output_filename, &opts))
   {
-    printf("Usage: %s FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]\n", argv[0]);
+    print_usage(argv[0]);
     return ERROR_ARGS;
   }
 
-  alloc_state(&s, gsize[ROWS], gsize[COLS], WITH_HALO);
+  if (opts.ensemble)
+    return ensemble_game(filename, gsize, max_gens, output_filename, &opts);
+
+  if (opts.radius > gsize[ROWS] || opts.radius > gsize[COLS])
+  {
+    fprintf(stderr, "Error: radius %d is larger than the board\n", opts.radius);
+    exit(ERROR_ARGS);
+  }
+
+  /* the halo is as deep as the neighborhood radius */
+  alloc_state(&s, gsize[ROWS], gsize[COLS], opts.radius);
 
   FILE * ifile = fopen(filename, "r");
   if (!ifile)
@@ -70,7 +95,7 @@ int main(int argc, char **argv)
 
   for (int y=s.halo; y<s.rows+s.halo; ++y)
   {
-    int readcnt = fread(s.space[y]+s.halo, sizeof(char), s.cols, ifile);
+    int readcnt = fread(SPACE_ROW(&s, y)+s.halo, sizeof(char), s.cols, ifile);
     if (readcnt != s.cols) {
         fprintf(stderr,
                 "ERROR, syntax error in '%s'. fread returned %d instead of %d\n",
@@ -83,18 +108,44 @@ int main(int argc, char **argv)
   }
   fclose(ifile);
 
-  game(&s, max_gens);
+  if (opts.autotune && !autotune(&s, &opts))
+  {
+    fprintf(stderr, "Error: no kernel can run this board\n");
+    exit(ERROR_ARGS);
+  }
+
+  if (!set_kernel(&s, &opts))
+  {
+    fprintf(stderr, "Error: cannot use kernel '%s'\n", opts.kernel);
+    exit(ERROR_ARGS);
+  }
+
+  cycle_init(&cycle, opts.cycle_window);
+
+  s_time = wall_time();
+  game(&s, max_gens, &cycle);
+  c_time = wall_time() - s_time;
   printf("\nGlobal Checksum after %ld generations: %ld\n", s.generation, s.checksum);
+  printf("Global Population: %ld\n", s.population);
+  print_stats(&s);
+  cycle_report(&cycle);
+
+  sync_state(&s);
 
   write_bmp(output_filename, &s);
   printf("\nFinal state dumped to %s\n", output_filename);
   
   print_state(&s, "output", gsize);
 
+  printf("\nRuntimes:\n");
+  printf("  Computation: %lf seconds (%.3e cells/s)\n", c_time,
+         (double) s.rows * s.cols * s.generation / c_time);
+
+  cycle_free(&cycle);
   free_state(&s);
 }
 
-void game(state * s, int max_gens)
+void game(state * s, int max_gens, cycle_state * cycle)
 {
   long sum_gendiff = 0.;
   while ((!max_gens && LIVE) || s->generation < max_gens)
@@ -107,10 +158,24 @@ void game(state * s, int max_gens)
     /* evolve */
 
 #if(LIVE)
+    sync_state(s);
     show(s, LIVE);
     usleep(DISPLAY_DELAY);
 #endif
-    sum_gendiff += evolve(s);
+    long changes = evolve(s);
+    sum_gendiff += changes;
+
+    /* cycle detection */
+    if (cycle_update(cycle, s->generation, changes, s->population, changes) &&
+        cycle_hash_due(cycle, s->generation) &&
+        cycle_confirm(cycle, s->generation, board_hash(s, 0, 0, s->cols)) &&
+        s->opts->early_stop && max_gens)
+    {
+      /* skip the remaining whole cycles, then compute the rest */
+      long skip = (max_gens - s->generation) / cycle->period * cycle->period;
+      s->checksum += cycle_skip(cycle, skip);
+      s->generation += skip;
+    }
   }
 
   //show(s, LIVE);  /* This line prints to stdout the final state */
@@ -121,22 +186,22 @@ void game(state * s, int max_gens)
  */
 void swap_halo(state * s)
 {
-  /* update halo rows */
-  memcpy(s->space[0] + 1, s->space[s->rows] + 1, s->cols);
-  memcpy(s->space[s->rows+1] + 1, s->space[1] + 1, s->cols);
+  int h = s->halo;
 
-  /* update halo columns */
-  for (int y = 1; y <= s->rows; y++)
+  /* update halo rows */
+  for (int y = 0; y < h; y++)
   {
-    s->space[y][0]  = s->space[y][s->cols];
-    s->space[y][s->cols+1] = s->space[y][1];
+    memcpy(SPACE_ROW(s, y) + h, SPACE_ROW(s, s->rows+y) + h, s->cols);
+    memcpy(SPACE_ROW(s, s->rows+h+y) + h, SPACE_ROW(s, h+y) + h, s->cols);
   }
 
-  /* update halo corners */
-  s->space[0][0] = s->space[s->rows][s->cols];
-  s->space[0][s->cols+1] = s->space[s->rows][1];
-  s->space[s->rows+1][0] = s->space[1][s->cols];
-  s->space[s->rows+1][s->cols+1] = s->space[1][1];
+  /* update halo columns, including the halo rows (corners) */
+  for (int y = 0; y < s->rows+2*h; y++)
+  {
+    char * row = SPACE_ROW(s, y);
+    memcpy(row, row + s->cols, h);
+    memcpy(row + s->cols+h, row + h, h);
+  }
 }
 
 void print_state(state * s, const char * filename, int *gsize)
@@ -148,8 +213,116 @@ void print_state(state * s, const char * filename, int *gsize)
   int halo = s->halo;
   
   for (int y = halo; y < gsize[ROWS] + halo; ++y) {
-    fwrite(s->space[y]+halo, sizeof(char), gsize[COLS], ofile);
+    fwrite(SPACE_ROW(s, y)+halo, sizeof(char), gsize[COLS], ofile);
   }
 
   fclose(ofile);  
 }
+
+/*
+ * Evolve the boards listed in file `list` as a bit-sliced ensemble. Final
+ * states are written to OUTPUT_BMPFILE and "output" files numbered by board
+ */
+int ensemble_game(const char * list, int *gsize, int max_gens, const char * output_filename, options * opts)
+{
+  ensemble e;
+  char * names[ENSEMBLE_MAX];
+  char line[4096];
+  size_t cells = (size_t) gsize[ROWS] * gsize[COLS];
+  char * board;
+  double s_time, c_time;
+
+  if (opts->ltl || opts->cycle_window)
+  {
+    fprintf(stderr, "Error: ensembles only support Life-like rules, without cycle detection\n");
+    exit(ERROR_ARGS);
+  }
+
+  FILE * lfile = fopen(list, "r");
+  if (!lfile)
+  {
+    fprintf(stderr, "Error: %s %s\n", strerror(errno), list);
+    exit(errno);
+  }
+
+  if (!ensemble_init(&e, gsize[ROWS], gsize[COLS], opts))
+  {
+    fprintf(stderr, "Error: cannot allocate an ensemble of %d x %d boards\n", gsize[ROWS], gsize[COLS]);
+    exit(IOERR);
+  }
+  board = (char *) malloc(cells);
+
+  while (fgets(line, sizeof(line), lfile))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!*line)
+      continue;
+    if (e.boards == ENSEMBLE_MAX)
+    {
+      fprintf(stderr, "Error: more than %d boards in '%s'\n", ENSEMBLE_MAX, list);
+      exit(ERROR_ARGS);
+    }
+
+    FILE * ifile = fopen(line, "r");
+    if (!ifile)
+    {
+      fprintf(stderr, "Error: %s %s\n", strerror(errno), line);
+      exit(errno);
+    }
+    size_t readcnt = fread(board, sizeof(char), cells, ifile);
+    if (readcnt != cells) {
+        fprintf(stderr,
+                "ERROR, syntax error in '%s'. fread returned %zu instead of %zu\n",
+                line, readcnt, cells);
+        fprintf(stderr,
+                "       check if size (%d, %d) is correct for '%s'\n",
+                gsize[ROWS], gsize[COLS], line);
+        exit(IOERR);
+    }
+    fclose(ifile);
+
+    names[ensemble_add(&e, board)] = strdup(line);
+  }
+  fclose(lfile);
+
+  if (!e.boards)
+  {
+    fprintf(stderr, "Error: no boards in '%s'\n", list);
+    exit(ERROR_ARGS);
+  }
+
+  s_time = wall_time();
+  while (e.generation < max_gens)
+    ensemble_evolve(&e);
+  c_time = wall_time() - s_time;
+
+  printf("\nEnsemble of %d boards after %ld generations:\n", e.boards, e.generation);
+  for (int b = 0; b < e.boards; ++b)
+    printf("  Board %2d: Checksum %ld, Population %ld (%s)\n", b, e.checksum[b], e.population[b], names[b]);
+
+  /* OUTPUT_BMPFILE and "output", numbered before the extension */
+  const char * ext = strrchr(output_filename, '.');
+  int base = ext ? (int) (ext - output_filename) : (int) strlen(output_filename);
+  for (int b = 0; b < e.boards; ++b)
+  {
+    ensemble_get(&e, b, board);
+
+    snprintf(line, sizeof(line), "%.*s.%d%s", base, output_filename, b, ext ? ext : "");
+    write_bmp_seq_matrix(line, board, gsize[ROWS], gsize[COLS], gsize[COLS], 0);
+
+    snprintf(line, sizeof(line), "output.%d", b);
+    FILE * ofile = fopen(line, "w");
+    fwrite(board, sizeof(char), cells, ofile);
+    fclose(ofile);
+    free(names[b]);
+  }
+  printf("\nFinal states dumped to %.*s.N%s and output.N\n", base, output_filename, ext ? ext : "");
+
+  printf("\nRuntimes:\n");
+  printf("  Computation: %lf seconds (%.3e cells/s)\n", c_time,
+         (double) cells * e.boards * e.generation / c_time);
+
+  free(board);
+  ensemble_free(&e);
+  return EXIT_OK;
+}
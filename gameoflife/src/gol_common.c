@@ -3,11 +3,18 @@
 #include <string.h>
 #include <assert.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "gol_common.h"
 
 #define PRINT_GRAPHIC 1
 #define MIN(a,b) (a<b?a:b)
+#define MAX(a,b) (a>b?a:b)
 
 struct bmpfile_magic {
   unsigned char magic[2];
@@ -34,9 +41,286 @@ struct bmpinfo_header {
   uint32_t nimpcolors;
 };
 
-int parse_arguments(int argc, char *argv[], char **filename, int *gsize, int *max_gens, char **output_filename)
+#ifdef _MPI_
+#define OPTIONS "k:i:T:d:t:S:b:r:c:eax:"
+#else
+#define OPTIONS "k:i:T:t:S:b:r:c:eEa"
+#endif
+
+static const gol_kernel * kernels[] = {
+  &byte_kernel,
+  &packed_kernel,
+  &simd_kernel,
+  &colsum_kernel,
+  &lut_kernel,
+  &tiles_kernel,
+  &sparse_kernel,
+  &ltl_kernel,
+  NULL
+};
+
+const gol_kernel * get_kernel(int i)
+{
+  return kernels[i];
+}
+
+static const struct {
+  const char * name;
+  const char * rule;
+} named_rules[] = {
+  {"conway",   "B3/S23"},
+  {"highlife", "B36/S23"},
+  {"daynight", "B3678/S34678"},
+  {"seeds",    "B2/S"},
+  {NULL, NULL}
+};
+
+char life_rule[2][9] = {
+  {0, 0, 0, 1, 0, 0, 0, 0, 0},
+  {0, 0, 1, 1, 0, 0, 0, 0, 0}
+};
+
+/* parse a count range "a..b" (or "a"), returning the end of the range */
+static const char * parse_range(const char * str, int * lo, int * hi)
+{
+  char * end;
+
+  *lo = *hi = strtol(str, &end, 10);
+  if (end == str)
+    return NULL;
+  if (!strncmp(end, "..", 2))
+  {
+    str = end + 2;
+    *hi = strtol(str, &end, 10);
+    if (end == str || *hi < *lo)
+      return NULL;
+  }
+  return end;
+}
+
+/*
+ * parse a Larger than Life rulestring, e.g. R5,C0,M1,S34..58,B34..45,NM
+ * (radius, states, middle cell counted, survive and birth count ranges,
+ * Moore neighborhood)
+ */
+static int parse_ltl_rule(const char * str, options * opts)
+{
+  int seen = 0;
+
+  opts->ltl = 1;
+  opts->middle = 0;
+  while (*str)
+  {
+    int v;
+    char key = toupper(*str++);
+    char * end = (char *) str;
+
+    switch (key)
+    {
+      case 'R':
+        opts->radius = strtol(str, &end, 10);
+        if (end == str || opts->radius < 1)
+          return 0;
+        seen |= 1;
+        break;
+      case 'C':
+        /* only two states (0 and 2 mean the same) */
+        v = strtol(str, &end, 10);
+        if (end == str || (v != 0 && v != 2))
+          return 0;
+        break;
+      case 'M':
+        opts->middle = strtol(str, &end, 10);
+        if (end == str || (opts->middle != 0 && opts->middle != 1))
+          return 0;
+        break;
+      case 'S':
+        if (!(end = (char *) parse_range(str, &opts->survive_min, &opts->survive_max)))
+          return 0;
+        seen |= 2;
+        break;
+      case 'B':
+        if (!(end = (char *) parse_range(str, &opts->birth_min, &opts->birth_max)))
+          return 0;
+        seen |= 4;
+        break;
+      case 'N':
+        if (toupper(*end++) != 'M')
+          return 0;
+        break;
+      default:
+        return 0;
+    }
+    str = end;
+    if (*str && *str++ != ',')
+      return 0;
+  }
+
+  if (seen != 7)
+    return 0;
+  if (!opts->birth_min)
+  {
+    fprintf(stderr, "Error: rules with B0 are not supported\n");
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * parse a rulestring in B/S notation (e.g. B36/S23), in Larger than Life
+ * notation, or a rule name
+ */
+static int parse_rule(const char * str, options * opts)
+{
+  int * birth = &opts->birth, * survive = &opts->survive;
+
+  for (int i = 0; named_rules[i].name; ++i)
+    if (!strcasecmp(str, named_rules[i].name))
+      str = named_rules[i].rule;
+
+  opts->radius = 1;
+  opts->ltl = 0;
+  if (toupper(*str) == 'R')
+    return parse_ltl_rule(str, opts);
+
+  *birth = *survive = 0;
+  if (toupper(*str++) != 'B')
+    return 0;
+  for (; isdigit(*str); ++str)
+  {
+    if (*str == '9')
+      return 0;
+    *birth |= 1 << (*str - '0');
+  }
+  if (*str++ != '/' || toupper(*str++) != 'S')
+    return 0;
+  for (; isdigit(*str); ++str)
+  {
+    if (*str == '9')
+      return 0;
+    *survive |= 1 << (*str - '0');
+  }
+  if (*str)
+    return 0;
+
+  /* empty regions would come alive every other generation */
+  if (*birth & 1)
+  {
+    fprintf(stderr, "Error: rules with B0 are not supported\n");
+    return 0;
+  }
+  return 1;
+}
+
+int parse_arguments(int argc, char *argv[], char **filename, int *gsize, int *max_gens, char **output_filename, options * opts)
 {
-if (argc == 1)
+  int opt, kernel_set = 0;
+
+  opts->kernel = DEFAULT_KERNEL;
+  opts->isa = DEFAULT_ISA;
+  opts->tile = DEFAULT_TILE;
+  opts->depth = DEFAULT_DEPTH;
+  opts->exchange = DEFAULT_EXCHANGE;
+  opts->threads = DEFAULT_THREADS;
+  opts->schedule = SCHEDULE_STATIC;
+  opts->chunk = 0;
+  opts->block = BLOCK_AUTO;
+  opts->rule = DEFAULT_RULE;
+  opts->birth = RULE_CONWAY_B;
+  opts->survive = RULE_CONWAY_S;
+  opts->radius = 1;
+  opts->ltl = 0;
+  opts->cycle_window = 0;
+  opts->early_stop = 0;
+  opts->ensemble = 0;
+  opts->autotune = 0;
+
+  while ((opt = getopt(argc, argv, OPTIONS)) != -1)
+  {
+    switch (opt)
+    {
+      case 'k':
+        opts->kernel = optarg;
+        kernel_set = 1;
+        break;
+      case 'i':
+        opts->isa = optarg;
+        break;
+      case 'T':
+        opts->tile = atoi(optarg);
+        if (opts->tile <= 0)
+          return 0;
+        break;
+      case 'd':
+        opts->depth = atoi(optarg);
+        if (opts->depth <= 0)
+          return 0;
+        break;
+      case 't':
+        opts->threads = atoi(optarg);
+        if (opts->threads < 0)
+          return 0;
+        break;
+      case 'S':
+        if (!strncmp(optarg, "static", 6))
+          opts->schedule = SCHEDULE_STATIC;
+        else if (!strncmp(optarg, "dynamic", 7))
+          opts->schedule = SCHEDULE_DYNAMIC;
+        else
+          return 0;
+        /* optional strip height, e.g. dynamic,16 */
+        if (strchr(optarg, ','))
+        {
+          opts->chunk = atoi(strchr(optarg, ',') + 1);
+          if (opts->chunk <= 0)
+            return 0;
+        }
+        break;
+      case 'b':
+        opts->block = strcmp(optarg, "auto") ? atoi(optarg) : BLOCK_AUTO;
+        if (opts->block < 0 && opts->block != BLOCK_AUTO)
+          return 0;
+        break;
+      case 'r':
+        opts->rule = optarg;
+        if (!parse_rule(optarg, opts))
+          return 0;
+        break;
+      case 'c':
+        opts->cycle_window = atoi(optarg);
+        if (opts->cycle_window < 0)
+          return 0;
+        break;
+      case 'e':
+        opts->early_stop = 1;
+        break;
+      case 'E':
+        opts->ensemble = 1;
+        break;
+      case 'a':
+        opts->autotune = 1;
+        break;
+      case 'x':
+        opts->exchange = optarg;
+        break;
+      default:
+        return 0;
+    }
+  }
+
+  /* early termination needs cycle detection */
+  if (opts->early_stop && !opts->cycle_window)
+    opts->cycle_window = DEFAULT_CYCLE_WINDOW;
+
+  /* Larger than Life rules are computed by their own kernel */
+  if (opts->ltl && !kernel_set)
+    opts->kernel = "ltl";
+
+  /* skip the options, so that argv[1] is the first positional argument */
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if (argc == 1)
   {
     *filename = DEFAULT_IFILE;
     gsize[ROWS] = DEFAULT_HEIGHT;
@@ -63,68 +347,588 @@ if (argc == 1)
   return 1;
 }
 
+void print_usage(const char * prog)
+{
+#ifdef _MPI_
+  printf("Usage: %s [-k KERNEL] [-i ISA] [-T TILE] [-t THREADS] [-S SCHEDULE] [-b BLOCK] [-r RULE] [-c WINDOW] [-e] [-a] [-d DEPTH] [-x MODE] FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]\n", prog);
+#else
+  printf("Usage: %s [-k KERNEL] [-i ISA] [-T TILE] [-t THREADS] [-S SCHEDULE] [-b BLOCK] [-r RULE] [-c WINDOW] [-e] [-a] [-E] FILENAME ROWS COLS GENS [OUTPUT_BMPFILE]\n", prog);
+#endif
+  printf("  -k KERNEL  evolve kernel (default: %s). Available:", DEFAULT_KERNEL);
+  for (const gol_kernel ** k = kernels; *k; ++k)
+    printf(" %s", (*k)->name);
+  printf("\n");
+  printf("  -i ISA     instruction set for the simd kernel (default: %s)\n", DEFAULT_ISA);
+  printf("             auto, avx512, avx2, sse2 or scalar\n");
+  printf("  -T TILE    tile edge for the tiles kernel (default: %d)\n", DEFAULT_TILE);
+  printf("  -t THREADS evolve threads, 0 for all available (default: %d)\n", DEFAULT_THREADS);
+  printf("  -S SCHED   row strips scheduling: static or dynamic, optionally\n");
+  printf("             followed by the strip height, e.g. dynamic,16 (default: static)\n");
+  printf("  -b BLOCK   column block for the simd and colsum kernels, 0 for full\n");
+  printf("             rows (default: auto, sized to the L1 data cache)\n");
+  printf("  -r RULE    Life-like rule in B/S notation (default: %s), or one of:", DEFAULT_RULE);
+  for (int i = 0; named_rules[i].name; ++i)
+    printf(" %s", named_rules[i].name);
+  printf("\n");
+  printf("             or Larger than Life rule, e.g. R5,C0,M1,S34..58,B34..45\n");
+  printf("  -c WINDOW  detect cycles up to WINDOW/2 generations long (default: 0, off)\n");
+  printf("  -e         stop early once a cycle is found, extrapolating the checksum\n");
+  printf("             (default window: %d)\n", DEFAULT_CYCLE_WINDOW);
+  printf("  -a         pick the fastest kernel, tile and threads with a short probe,\n");
+  printf("             cached per board shape in $GOL_TUNE_FILE or ~/%s\n", ".gameoflife_tune");
+#ifndef _MPI_
+  printf("  -E         FILENAME lists up to %d input files, one per line, evolved\n", ENSEMBLE_MAX);
+  printf("             together as a bit-sliced ensemble (Life-like rules only)\n");
+#endif
+#ifdef _MPI_
+  printf("  -d DEPTH   halo depth: generations computed per halo exchange (default: %d)\n", DEFAULT_DEPTH);
+  printf("  -x MODE    halo exchange: overlap (nonblocking, computing the interior\n");
+  printf("             meanwhile), persistent (the same with persistent requests),\n");
+  printf("             neighbor (one neighborhood collective), fence, pscw or\n");
+  printf("             notify (one-sided puts) or blocking\n");
+  printf("             (default: %s)\n", DEFAULT_EXCHANGE);
+#endif
+}
+
+void set_threads(const options * opts)
+{
+#ifdef _OPENMP
+  if (opts->threads)
+    omp_set_num_threads(opts->threads);
+  omp_set_schedule(opts->schedule == SCHEDULE_DYNAMIC ? omp_sched_dynamic : omp_sched_static,
+                   opts->chunk);
+#else
+  if (opts->threads != 1)
+    fprintf(stderr, "Warning: built without OpenMP, running a single thread\n");
+#endif
+}
+
+/* fill `life_rule` out of the rule masks */
+static void set_rule(const options * opts)
+{
+  for (int n = 0; n <= 8; ++n)
+  {
+    life_rule[0][n] = opts->birth >> n & 1;
+    life_rule[1][n] = opts->survive >> n & 1;
+  }
+}
+
+int set_kernel(state * s, const options * opts)
+{
+  for (const gol_kernel ** k = kernels; *k; ++k)
+  {
+    if (!strcmp((*k)->name, opts->kernel))
+    {
+      if (s->halo > 1 && !(*k)->deep_halo)
+      {
+        fprintf(stderr, "Error: kernel '%s' does not support halos deeper than 1\n", (*k)->name);
+        return 0;
+      }
+      if (opts->ltl != (*k)->ltl)
+      {
+        fprintf(stderr, "Error: kernel '%s' does not support %s rules\n", (*k)->name,
+                opts->ltl ? "Larger than Life" : "Life-like");
+        return 0;
+      }
+      if (!opts->ltl && (opts->birth != RULE_CONWAY_B || opts->survive != RULE_CONWAY_S) && !(*k)->any_rule)
+      {
+        fprintf(stderr, "Error: kernel '%s' only supports rule %s\n", (*k)->name, DEFAULT_RULE);
+        return 0;
+      }
+      if (s->halo && s->halo < opts->radius)
+      {
+        fprintf(stderr, "Error: halo narrower than the neighborhood radius %d\n", opts->radius);
+        return 0;
+      }
+      if (s->kernel->release)
+        s->kernel->release(s);
+      s->kdata = NULL;
+      s->kernel = *k;
+      s->opts = opts;
+      s->radius = opts->radius;
+      set_threads(opts);
+      set_rule(opts);
+      s->population = count_population(s);
+      return !s->kernel->init || s->kernel->init(s);
+    }
+  }
+  return 0;
+}
+
+void print_stats(state * s)
+{
+#ifdef _OPENMP
+  if (s->opts)
+    printf("  Threads: %d (%s scheduling)\n", omp_get_max_threads(),
+           s->opts->schedule == SCHEDULE_DYNAMIC ? "dynamic" : "static");
+#endif
+  if (s->block)
+    printf("  Column blocks: %d cells\n", s->block);
+  if (s->opts && strcmp(s->opts->rule, DEFAULT_RULE))
+    printf("  Rule: %s\n", s->opts->rule);
+  if (s->kernel->report)
+    s->kernel->report(s);
+}
+
+void sync_state(state * s)
+{
+  if (s->kernel->sync)
+    s->kernel->sync(s);
+}
+
 long evolve(state * s)
 {
-  long checksum = 0;
+  long checksum = s->kernel->evolve(s);
+  char * tmp = s->space;
+
+  s->space = s->next;
+  s->next = tmp;
+  s->generation++;
+  s->checksum += checksum;
+  return checksum;
+}
+
+void evolve_interior(state * s)
+{
+  assert(s->kernel->parts && s->halo);
+
+  s->part = PART_INTERIOR;
+  s->part_checksum = s->kernel->evolve(s);
+  s->part_population = s->population;
+  s->part = PART_BOUNDARY;
+}
+
+long evolve_boundary(state * s)
+{
+  long checksum;
+
+  assert(s->part == PART_BOUNDARY);
+
+  checksum = evolve(s) + s->part_checksum;
+  s->checksum += s->part_checksum;
+  s->population += s->part_population;
+  s->part = PART_ALL;
+  return checksum;
+}
+
+/* the cell is in the part of the generation being computed */
+static inline int in_part(const state * s, int y, int x)
+{
+  int interior = y > s->halo && y < s->rows + s->halo - 1 &&
+                 x > s->halo && x < s->cols + s->halo - 1;
+
+  return s->part == PART_ALL || interior == (s->part == PART_INTERIOR);
+}
+
+/* reference rule on a single row, see `row_fn` */
+static long row_byte(const char * up, const char * mid, const char * down, char * out, int n,
+                     long * population)
+{
+  long checksum = 0, live = 0;
+
+  for (int x = 0; x < n; x++)
+  {
+    int c = up[x-1] + up[x] + up[x+1] +
+            mid[x-1] + mid[x+1] +
+            down[x-1] + down[x] + down[x+1];
+    out[x] = life_rule[(int) mid[x]][c];
+    checksum += out[x] != mid[x];
+    live += out[x];
+  }
+  *population += live;
+  return checksum;
+}
+
+/* single cell at column x of a row, with explicit left/right neighbor columns */
+static inline long wrap_cell(const char * up, const char * mid, const char * down, char * out,
+                             int x, int xl, int xr, long * population)
+{
+  int c = up[xl] + up[x] + up[xr] +
+          mid[xl] + mid[xr] +
+          down[xl] + down[x] + down[xr];
+  out[x] = life_rule[(int) mid[x]][c];
+  *population += out[x];
+  return out[x] != mid[x];
+}
+
+/*
+ * Generation of a state without halos, wrapping around the edges.
+ * Neighbor rows are picked once per row, so the first and last rows are
+ * computed like any other one, and only the first and last columns need
+ * wrapped neighbors. Columns [1, w-2] are computed by `row` without any
+ * wrap logic.
+ */
+static long evolve_wrap(state * s, row_fn row)
+{
+  long checksum = 0, population = 0;
+  int h = s->rows,
+      w = s->cols;
+
+  assert(!s->halo && !s->margin);
+
+  #pragma omp parallel for schedule(runtime) reduction(+:checksum,population)
+  for (int y = 0; y < h; y++)
+  {
+    const char * up   = SPACE_ROW(s, y ? y-1 : h-1),
+               * mid  = SPACE_ROW(s, y),
+               * down = SPACE_ROW(s, y < h-1 ? y+1 : 0);
+    char * out = NEXT_ROW(s, y);
+
+    checksum += wrap_cell(up, mid, down, out, 0, w-1, w > 1, &population);
+    if (w > 2)
+      checksum += row(up+1, mid+1, down+1, out+1, w-2, &population);
+    if (w > 1)
+      checksum += wrap_cell(up, mid, down, out, w-1, w-2, 0, &population);
+  }
+
+  s->population = population;
+  return checksum;
+}
+
+/*
+ * Reference kernel: one byte per cell
+ */
+static long evolve_byte(state * s)
+{
+  long checksum = 0, population = 0;
   int halo = s->halo,
       h    = s->rows,
-      w    = s->cols;
+      w    = s->cols,
+      m    = s->margin;
 
-  assert(halo == 0 || halo == 1);
+  if (!halo)
+    return evolve_wrap(s, row_byte);
 
-  char * temp_ptr = s->s_temp;
+  assert(m < halo);
 
-  for (int y = halo; y < h+halo; y++)
+  #pragma omp parallel for schedule(runtime) reduction(+:checksum,population)
+  for (int y = halo-m; y < h+halo+m; y++)
   {
-    for (int x = halo; x < w+halo; x++)
+    int inner = y >= halo && y < h+halo;
+    char * out = NEXT_ROW(s, y);
+    for (int x = halo-m; x < w+halo+m; x++)
     {
       int n = 0, y1, x1;
 
-      if (s->space[y][x]) n--;
+      if (!in_part(s, y, x))
+        continue;
+      if (SPACE(s, y, x)) n--;
       for (y1 = y - 1; y1 <= y + 1; y1++)
       {
         for (x1 = x - 1; x1 <= x + 1; x1++)
         {
-          if (halo)
-            n += s->space[y1][x1];
-          else
-          {
-            //Note: mod operation affects performance
-            n += s->space[(y1 + h)%h][(x1 + w)%w];
-          }
+          n += SPACE(s, y1, x1);
         }
       }
-      *temp_ptr = (n == 3 || (n == 2 && s->space[y][x]));
-      checksum += s->space[y][x] != *temp_ptr;
-      ++temp_ptr;
+      out[x] = life_rule[(int) SPACE(s, y, x)][n];
+      /* margin cells are not part of the checksum */
+      if (inner && x >= halo && x < w+halo)
+      {
+        checksum += SPACE(s, y, x) != out[x];
+        population += out[x];
+      }
     }
   }
 
-  temp_ptr = s->s_temp;
-  for (int y = halo; y < s->rows+halo; y++)
+  s->population = population;
+  return checksum;
+}
+
+const gol_kernel byte_kernel = {"byte", NULL, evolve_byte, NULL, NULL, NULL, 1, 1, 0, 1};
+
+/*
+ * Sliding column sums: the count of each cell is derived from the vertical
+ * sums (up+mid+down) of columns x-1, x and x+1, which are reused for the next
+ * cells, so only one new column is loaded per cell
+ */
+static long row_colsum(const char * up, const char * mid, const char * down, char * out, int n,
+                       long * population)
+{
+  long checksum = 0, live = 0;
+  int left   = up[-1] + mid[-1] + down[-1],
+      center = up[0] + mid[0] + down[0];
+
+  for (int x = 0; x < n; ++x)
   {
-    memcpy(s->space[y]+halo, temp_ptr, s->cols);
-    temp_ptr += s->cols;
+    int right = up[x+1] + mid[x+1] + down[x+1];
+    int c = left + center + right; /* includes the cell itself */
+
+    out[x] = (c == 3) | ((c == 4) & mid[x]);
+    checksum += out[x] ^ mid[x];
+    live += out[x];
+    left = center;
+    center = right;
   }
+  *population += live;
+  return checksum;
+}
 
-  s->generation++;
-  s->checksum += checksum;
+static long evolve_colsum(state * s)
+{
+  return evolve_rows(s, row_colsum);
+}
+
+const gol_kernel colsum_kernel = {"colsum", NULL, evolve_colsum, NULL, NULL, NULL, 1, 0, 0, 1};
+
+/*
+ * Lookup-table kernel: the board is advanced in 2x2 blocks, looking up the
+ * next state of each block from its 4x4 neighbourhood.
+ * Index bit (4*r + c) is the cell at row r, column c of the 4x4 neighbourhood.
+ * Entry bits 0-3 are the next state of the 2x2 center (row major),
+ * bits 4-6 the number of center cells that change.
+ */
+#define LUT_SIZE (1 << 16)
+
+static unsigned char lut[LUT_SIZE];
+
+static int init_lut(state * s)
+{
+  static int ready = 0, birth, survive;
+  int b = s->opts ? s->opts->birth : RULE_CONWAY_B,
+      su = s->opts ? s->opts->survive : RULE_CONWAY_S;
+
+  if (ready && birth == b && survive == su)
+    return 1;
+
+  for (int idx = 0; idx < LUT_SIZE; ++idx)
+  {
+    int entry = 0, changes = 0;
+    for (int y = 1; y <= 2; ++y)
+    {
+      for (int x = 1; x <= 2; ++x)
+      {
+        int n = 0, cell = (idx >> (4*y + x)) & 1;
+        for (int y1 = y - 1; y1 <= y + 1; ++y1)
+          for (int x1 = x - 1; x1 <= x + 1; ++x1)
+            n += (idx >> (4*y1 + x1)) & 1;
+        n -= cell;
+        int next = life_rule[cell][n];
+        entry |= next << (2*(y-1) + (x-1));
+        changes += next != cell;
+      }
+    }
+    lut[idx] = entry | (changes << 4);
+  }
+  ready = 1;
+  birth = b;
+  survive = su;
+  return 1;
+}
+
+/* single cell, for the odd row/column left out of the 2x2 blocks */
+static inline long evolve_cell(state * s, int y, int x, char * out, long * population)
+{
+  int n = 0;
+  for (int y1 = y - 1; y1 <= y + 1; y1++)
+    for (int x1 = x - 1; x1 <= x + 1; x1++)
+      n += SPACE(s, y1, x1);
+  n -= SPACE(s, y, x);
+  *out = life_rule[(int) SPACE(s, y, x)][n];
+  *population += *out;
+  return *out != SPACE(s, y, x);
+}
+
+static long evolve_lut(state * s)
+{
+  long checksum = 0, population = 0;
+  int halo = s->halo,
+      h    = s->rows,
+      w    = s->cols;
+
+  if (!halo)
+    return evolve_byte(s);
+
+  #pragma omp parallel for schedule(runtime) reduction(+:checksum,population)
+  for (int y = 1; y < h; y += 2)
+  {
+    const char * r0 = SPACE_ROW(s, y-1), * r1 = SPACE_ROW(s, y),
+               * r2 = SPACE_ROW(s, y+1), * r3 = SPACE_ROW(s, y+2);
+    char * out0 = NEXT_ROW(s, y),
+         * out1 = NEXT_ROW(s, y+1);
+    /* 4x4 window: bits 0-1 are columns x-1 and x of each row */
+    unsigned win = (r0[0] | r0[1] << 1) | (r1[0] | r1[1] << 1) << 4 |
+                   (r2[0] | r2[1] << 1) << 8 | (r3[0] | r3[1] << 1) << 12;
+
+    for (int x = 1; x + 1 <= w; x += 2)
+    {
+      win |= (r0[x+1] << 2 | r0[x+2] << 3) |
+             (r1[x+1] << 2 | r1[x+2] << 3) << 4 |
+             (r2[x+1] << 2 | r2[x+2] << 3) << 8 |
+             (r3[x+1] << 2 | r3[x+2] << 3) << 12;
+
+      unsigned char e = lut[win];
+      out0[x]   = e & 1;
+      out0[x+1] = (e >> 1) & 1;
+      out1[x]   = (e >> 2) & 1;
+      out1[x+1] = (e >> 3) & 1;
+      checksum += e >> 4;
+      population += __builtin_popcount(e & 15);
+
+      /* slide by two columns */
+      win = (win >> 2) & 0x3333;
+    }
+    if (w & 1)
+    {
+      checksum += evolve_cell(s, y, w, out0 + w, &population);
+      checksum += evolve_cell(s, y+1, w, out1 + w, &population);
+    }
+  }
+  if (h & 1)
+  {
+    checksum += row_byte(SPACE_ROW(s, h-1)+1, SPACE_ROW(s, h)+1, SPACE_ROW(s, h+1)+1,
+                         NEXT_ROW(s, h)+1, w, &population);
+  }
+
+  s->population = population;
+  return checksum;
+}
+
+const gol_kernel lut_kernel = {"lut", init_lut, evolve_lut, NULL, NULL, NULL, 0, 1};
+
+/*
+ * Column block for the cache-blocked sweep: the three input rows and the
+ * output row of a block are kept within half of the L1 data cache
+ */
+static int auto_block(void)
+{
+  static int block = 0;
+
+  if (!block)
+  {
+    long l1 = 0;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+    if (l1 <= 0)
+      l1 = DEFAULT_L1_SIZE;
+    block = MAX(l1 / 8 / ALIGNMENT, 1) * ALIGNMENT;
+  }
+  return block;
+}
+
+/*
+ * cells [a, b) of a row, where only cells [c0, c1) are part of the checksum
+ * and the population
+ */
+static inline long row_part(row_fn row, const char * up, const char * mid, const char * down,
+                            char * out, int a, int b, int c0, int c1, long * population)
+{
+  int l = MIN(MAX(c0, a), b),
+      r = MAX(MIN(c1, b), l);
+  long checksum = 0, margin = 0;
+
+  if (l > a)
+    row(up+a, mid+a, down+a, out+a, l-a, &margin);
+  if (r > l)
+    checksum = row(up+l, mid+l, down+l, out+l, r-l, population);
+  if (b > r)
+    row(up+r, mid+r, down+r, out+r, b-r, &margin);
   return checksum;
 }
 
+long evolve_rows(state * s, row_fn row)
+{
+  long checksum = 0, population = 0;
+  int halo  = s->halo,
+      h     = s->rows,
+      w     = s->cols,
+      m     = s->margin,
+      x0    = halo - m,
+      n     = w + 2*m,
+      block = s->opts ? s->opts->block : BLOCK_AUTO;
+
+  if (!halo)
+    return evolve_wrap(s, row);
+
+  if (block == BLOCK_AUTO)
+    block = auto_block();
+  s->block = block && block < n ? block : 0;
+  if (!s->block)
+    block = n;
+
+  /* sweep all rows of a column block before moving to the next one */
+  #pragma omp parallel reduction(+:checksum,population)
+  for (int a = 0; a < n; a += block)
+  {
+    int b = MIN(a + block, n);
+
+    #pragma omp for schedule(runtime)
+    for (int y = halo-m; y < h+halo+m; y++)
+    {
+      const char * up = SPACE_ROW(s, y-1)+x0, * mid = SPACE_ROW(s, y)+x0, * down = SPACE_ROW(s, y+1)+x0;
+      char * out = NEXT_ROW(s, y)+x0;
+      int interior = y > halo && y < h+halo-1,
+          spans[2][2] = {{a, b}, {b, b}};
+
+      /* columns of the part: interior cells, or the ring around them */
+      if (s->part == PART_INTERIOR)
+      {
+        if (!interior)
+          continue;
+        spans[0][0] = MAX(a, m+1);
+        spans[0][1] = MIN(b, m+w-1);
+      }
+      else if (s->part == PART_BOUNDARY && interior)
+      {
+        spans[0][1] = MIN(b, m+1);
+        spans[1][0] = MAX(a, MAX(m+w-1, m+1));
+      }
+
+      for (int i = 0; i < 2; ++i)
+      {
+        if (spans[i][0] >= spans[i][1])
+          continue;
+        if (y < halo || y >= h+halo)
+        {
+          /* margin rows are not part of the checksum */
+          long margin = 0;
+          row_part(row, up, mid, down, out, spans[i][0], spans[i][1], 0, 0, &margin);
+        }
+        else
+          checksum += row_part(row, up, mid, down, out, spans[i][0], spans[i][1], m, m+w, &population);
+      }
+    }
+  }
+
+  s->population = population;
+  return checksum;
+}
+
+long count_population(state * s)
+{
+  long population = 0;
+
+  #pragma omp parallel for schedule(runtime) reduction(+:population)
+  for (int y = s->halo; y < s->rows+s->halo; ++y)
+  {
+    const char * row = SPACE_ROW(s, y) + s->halo;
+    for (int x = 0; x < s->cols; ++x)
+      population += row[x];
+  }
+  return population;
+}
+
+double wall_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 void show(state * s, int clear)
 {
-  int offset = s->halo != 0;
-  int xlimit = MIN((MAX_PRINTABLE_COLS+2*s->halo), (s->cols+2*s->halo));
-  int ylimit = MIN((MAX_PRINTABLE_ROWS+2*s->halo), (s->rows+2*s->halo));
+  int offset = s->halo;
+  int xlimit = MIN(MAX_PRINTABLE_COLS, s->cols) + s->halo;
+  int ylimit = MIN(MAX_PRINTABLE_ROWS, s->rows) + s->halo;
 
   printf(clear?"\033[H":"\n");
   for (int y = offset; y < ylimit; y++) {
     for (int x = offset; x < xlimit; x++) {
 #if(PRINT_GRAPHIC)
-      printf(s->space[y][x] ? "\033[07m  \033[m" : "  ");
+      printf(SPACE(s, y, x) ? "\033[07m  \033[m" : "  ");
 #else
-      printf("%c ", s->space[y][x] +'0');
+      printf("%c ", SPACE(s, y, x) +'0');
 #endif
     }
     printf(clear?"\033[E":"\n");
@@ -167,40 +971,50 @@ void show_space(void * s, int rows, int cols, int clear, int offset)
 
 void alloc_state(state * s, int rows, int cols, int halo)
 {
-  int alloc_rows = halo?(rows+2):rows,
-      alloc_cols = halo?(cols+2):cols;
-  int ystart = halo?1:0;
+  int alloc_rows = rows + 2*halo,
+      alloc_cols = cols + 2*halo;
+  /* padding before the halo columns, so that grid columns are aligned */
+  int lead = (ALIGNMENT - halo % ALIGNMENT) % ALIGNMENT;
+  int stride = (lead + alloc_cols + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  size_t plane_size = (size_t) alloc_rows * stride;
 
   s->rows      = rows;
   s->cols      = cols;
+  s->stride    = stride;
 
-
-  s->space     = (char **) malloc (alloc_rows * sizeof(char *));
-
+  /* both planes in a single block, so that they can be exposed at once */
 #ifdef _MPI_
-  MPI_Aint space_size = alloc_rows * alloc_cols * sizeof(char);
-  MPI_Alloc_mem(space_size, MPI_INFO_NULL, s->space);
+  MPI_Aint space_size = (2 * plane_size + ALIGNMENT) * sizeof(char);
+  MPI_Alloc_mem(space_size, MPI_INFO_NULL, &s->planes);
+  memset(s->planes, 0, space_size);
 #else
-  s->space[0]  = (char *) calloc (alloc_rows * alloc_cols, sizeof(char));
+  s->planes    = (char *) calloc (2 * plane_size + ALIGNMENT, sizeof(char));
 #endif
-  s->s_temp =  (char *) calloc (s->rows * s->cols, sizeof(char));
-  for (int y=ystart; y<alloc_rows; ++y)
-      s->space[y] = s->space[0] + y*alloc_cols;
+  s->space     = (char *) (((uintptr_t) s->planes + ALIGNMENT - 1) & ~(uintptr_t) (ALIGNMENT - 1)) + lead;
+  s->next      = s->space + plane_size;
 
   s->generation = 0;
   s->checksum = 0;
+  s->population = 0;
   s->halo = halo;
+  s->margin = 0;
+  s->radius = 1;
+  s->block = 0;
+  s->part = PART_ALL;
+  s->kernel = &byte_kernel;
+  s->kdata = NULL;
+  s->opts = NULL;
 }
 
 void free_state(state * s)
 {
+  if (s->kernel->release)
+    s->kernel->release(s);
 #ifdef _MPI_
-  MPI_Free_mem(s->space[0]);
+  MPI_Free_mem(s->planes);
 #else
-  free(s->space[0]);
+  free(s->planes);
 #endif
-  free(s->space);
-  free(s->s_temp);
 }
 
 
@@ -303,7 +1117,7 @@ void write_bmp_mpi(const char * filename, state * s, int * gsize, int * psize, M
   char * outptr = bmp_space;
   for (int y = halo; y < s->rows+halo; ++y) {
     for (int x = halo; x < s->cols+halo; ++x) {
-      int rgb = s->space[y][x]?0:255;
+      int rgb = SPACE(s, y, x)?0:255;
       *outptr++ = rgb;
       *outptr++ = rgb;
       *outptr++ = rgb;
@@ -322,7 +1136,7 @@ void write_bmp_mpi(const char * filename, state * s, int * gsize, int * psize, M
 
 void write_bmp(const char * filename, state * s)
 {
-  write_bmp_seq_matrix(filename, s->space, s->rows, s->cols, s->halo);
+  write_bmp_seq_matrix(filename, s->space, s->rows, s->cols, s->stride, s->halo);
 }
 
 /*
@@ -330,7 +1144,7 @@ void write_bmp(const char * filename, state * s)
  * Output image will be flipped vertically to match MPI version
  */
 #define FLIP_BMP 1
-void write_bmp_seq_matrix(const char * filename, char ** space, int rows, int cols, int halo)
+void write_bmp_seq_matrix(const char * filename, const char * space, int rows, int cols, int stride, int halo)
 {
   int gsize[2] = {rows, cols};
   int col_padding = gsize[1] % 4;
@@ -373,14 +1187,14 @@ void write_bmp_seq_matrix(const char * filename, char ** space, int rows, int co
 
   /* compute bitmap */
 #if(FLIP_BMP)
-  for (int y = halo; y < gsize[0] - halo; ++y) {
+  for (int y = halo; y < gsize[0] + halo; ++y) {
 #else
-  int revhalo = halo?0:1;
-  for (int y = gsize[0] - revhalo; y > -revhalo ; --y) {
+  for (int y = gsize[0] + halo - 1; y >= halo; --y) {
 #endif
     char * outptr = bmp_space;
+    const char * row = PLANE_ROW(space, stride, y);
     for (int x = halo; x < gsize[1]+halo; ++x) {
-      int rgb = space[y][x]?0:255;
+      int rgb = row[x]?0:255;
       *outptr++ = rgb;
       *outptr++ = rgb;
       *outptr++ = rgb;
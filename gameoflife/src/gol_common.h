@@ -13,25 +13,199 @@
 #define DEFAULT_OFILE   "gol.output.bmp"
 #define DEFAULT_HEIGHT  40
 #define DEFAULT_WIDTH   80
+#define DEFAULT_KERNEL  "simd"
+#define DEFAULT_ISA     "auto"
+#define DEFAULT_TILE    64
+#define DEFAULT_DEPTH   1
+#ifndef DEFAULT_EXCHANGE
+#define DEFAULT_EXCHANGE "overlap"
+#endif
+#define DEFAULT_THREADS 1
+#define DEFAULT_RULE    "B3/S23"
+#define DEFAULT_CYCLE_WINDOW 64
+#define ENSEMBLE_MAX    64 /* boards of an ensemble, one per bit of a word */
+#define DEFAULT_L1_SIZE 32768 /* L1 data cache size, if it cannot be detected */
+
+#define BLOCK_AUTO -1 /* column block sized to the detected cache */
+
+#define PART_ALL      0 /* whole generation */
+#define PART_INTERIOR 1 /* cells whose neighborhood is within the grid */
+#define PART_BOUNDARY 2 /* the other cells, reading the halo */
+
+#define SCHEDULE_STATIC  0 /* equal row strips, one per thread */
+#define SCHEDULE_DYNAMIC 1 /* strips handed out to idle threads */
 
 #define ROWS 0
 #define COLS 1
 
+#define ALIGNMENT 64 /* alignment of the grid rows: cache line, widest SIMD register */
+
+/*
+ * Life-like rules: bit k of the birth (survive) mask is set if a dead (live)
+ * cell with k live neighbors is alive in the next generation
+ */
+#define RULE_CONWAY_B   (1<<3)                             /* B3/S23 */
+#define RULE_CONWAY_S   (1<<2 | 1<<3)
+#define RULE_HIGHLIFE_B (1<<3 | 1<<6)                      /* B36/S23 */
+#define RULE_HIGHLIFE_S (1<<2 | 1<<3)
+#define RULE_DAYNIGHT_B (1<<3 | 1<<6 | 1<<7 | 1<<8)        /* B3678/S34678 */
+#define RULE_DAYNIGHT_S (1<<3 | 1<<4 | 1<<6 | 1<<7 | 1<<8)
+#define RULE_SEEDS_B    (1<<2)                             /* B2/S */
+#define RULE_SEEDS_S    0
+
+#include <stdint.h>
+
 #ifdef _MPI_
 #include <mpi.h>
 #endif
 
+typedef struct gol_kernel gol_kernel;
+
+typedef struct {
+  const char * kernel;  /* evolve kernel name */
+  const char * isa;     /* instruction set for vectorized kernels */
+  int tile;             /* tile edge for the active tiles kernel */
+  int depth;            /* halo depth: generations per halo exchange (MPI) */
+  const char * exchange; /* halo exchange mode (MPI) */
+  int threads;          /* evolve threads, 0 for the OpenMP default */
+  int schedule;         /* SCHEDULE_STATIC or SCHEDULE_DYNAMIC */
+  int chunk;            /* rows per strip, 0 for the default */
+  int block;            /* column block of the row kernels, 0 for full rows
+                           or BLOCK_AUTO */
+  const char * rule;    /* rulestring, e.g. B3/S23 */
+  int birth;            /* birth mask of the rule */
+  int survive;          /* survive mask of the rule */
+  int ltl;              /* Larger than Life rule, given by the fields below */
+  int radius;           /* neighborhood radius, 1 for Life-like rules */
+  int middle;           /* the cell itself is part of its neighbor count */
+  int birth_min, birth_max;     /* neighbor counts for a dead cell to be born */
+  int survive_min, survive_max; /* neighbor counts for a live cell to survive */
+  int cycle_window;     /* generations searched for cycles, 0 to disable */
+  int early_stop;       /* skip the remaining cycles once one is found */
+  int ensemble;         /* the input file lists the boards of an ensemble */
+  int autotune;         /* pick kernel, tile and threads at startup */
+} options;
+
 typedef struct {
   int   rows;       	/* no. of rows in grid */
   int   cols;       	/* no. of columns in grid */
-  char **space;    	/* a pointer to a list of pointers for storing
-                     	   a dynamic NxM grid of cells */
-  char *s_temp;    	/* temporary space for the evolution process */
+  char *space;     	/* flat plane storing the (rows+2*halo)x(cols+2*halo)
+                     	   grid of cells, halo included, `stride` bytes
+                     	   per row */
+  char *next;           /* plane receiving the next generation,
+                           swapped with `space` after each generation */
+  int   stride;         /* bytes per plane row, multiple of ALIGNMENT */
+  char *planes;         /* memory block holding both planes */
   long generation;
   long checksum;
-  int halo;
+  long population;      /* live grid cells of the last generation, set by
+                           the kernel together with the changed cells */
+  int halo;             /* width of the halo around the grid */
+  int margin;           /* halo ring computed together with the grid,
+                           for halos deeper than the neighborhood radius
+                           (0 <= margin <= halo - radius) */
+  int radius;           /* neighborhood radius of the rule */
+  int block;            /* column block of the last generation, 0 if it
+                           was computed by full rows */
+  int part;             /* part of the generation computed by the kernel */
+  long part_checksum;   /* changed cells of the interior part */
+  long part_population; /* live cells of the interior part */
+  const gol_kernel * kernel; /* evolve kernel in use */
+  void * kdata;              /* kernel private representation (if any) */
+  const options * opts;      /* settings for the kernel */
 } state;
 
+/* bit-sliced ensemble of boards evolved together, see gol_ensemble.c */
+typedef struct {
+  int rows;             /* no. of rows of every board */
+  int cols;             /* no. of columns of every board */
+  int boards;           /* boards added, bit b of a word is board b */
+  int birth;            /* birth mask of the rule */
+  int survive;          /* survive mask of the rule */
+  uint64_t * plane;     /* (rows+2)x(cols+2) words, 1 cell halo included */
+  uint64_t * next;      /* plane receiving the next generation */
+  long generation;
+  long checksum[ENSEMBLE_MAX];   /* changed cells of each board */
+  long population[ENSEMBLE_MAX]; /* live cells of each board */
+} ensemble;
+
+/* cycle detection over the signatures of the last generations, see gol_cycle.c */
+typedef struct {
+  int window;           /* generations kept */
+  long * changes;       /* changed cells of each generation (global) */
+  long * population;    /* live cells of each generation (global) */
+  long * local;         /* changed cells of each generation in this state */
+  long last;            /* last generation recorded */
+  long recorded;        /* generations recorded */
+  int period;           /* candidate (or confirmed) period, 0 if none */
+  int min_period;       /* shortest period not ruled out by a hash */
+  long ref_generation;  /* generation of the reference hash, -1 if none */
+  uint64_t ref_hash;    /* board hash at `ref_generation` */
+  long start;           /* first generation of the cycle */
+  long found;           /* generation the cycle was confirmed at, -1 if none */
+  long skipped;         /* generations skipped by early termination */
+} cycle_state;
+
+/*
+ * Plane accessors. Coordinates include the halo, so that (halo, halo) is the
+ * first cell of the grid. The first grid cell of every row is aligned to
+ * ALIGNMENT bytes.
+ */
+#define PLANE_ROW(plane, stride, y) ((plane) + (size_t)(y) * (stride))
+#define SPACE_ROW(s, y)  PLANE_ROW((s)->space, (s)->stride, y)
+#define NEXT_ROW(s, y)   PLANE_ROW((s)->next, (s)->stride, y)
+#define SPACE(s, y, x)   SPACE_ROW(s, y)[x]
+#define NEXT(s, y, x)    NEXT_ROW(s, y)[x]
+
+/*
+ * An evolve kernel computes one generation of a state from `space` into
+ * `next`, at the same coordinates. Cells it does not write keep the value
+ * of two generations ago.
+ * Kernels keeping their own representation of the board (e.g. bit-packed)
+ * read the halos from `space` before each generation and write back the
+ * bounding rows/columns afterwards, so that halo exchange keeps working on
+ * `space`. The whole `space` is only brought up to date by `sync`.
+ */
+struct gol_kernel {
+  const char * name;
+  int  (*init)(state * s);    /* build private data out of s->space */
+  long (*evolve)(state * s);  /* compute one generation, return changed cells
+                                 and set s->population */
+  void (*sync)(state * s);    /* write private data back into s->space */
+  void (*release)(state * s); /* free private data */
+  void (*report)(state * s);  /* print kernel statistics */
+  int deep_halo;              /* supports halos deeper than 1 and margins */
+  int any_rule;               /* supports rules other than B3/S23 */
+  int ltl;                    /* computes Larger than Life rules instead */
+  int parts;                  /* computes the interior and boundary of a
+                                 generation separately, see `s->part` */
+};
+
+/*
+ * Computes cells [0, n) of a row into `out`. `up`, `mid` and `down` point to
+ * the first cell of the rows, and cells [-1] and [n] must be valid.
+ * Returns the number of changed cells, and adds the live cells of `out` to
+ * `*population`.
+ */
+typedef long (*row_fn)(const char * up, const char * mid, const char * down, char * out, int n,
+                       long * population);
+
+/*
+ * Next state of a cell, indexed by [alive][live neighbors], for the rule
+ * of the last kernel set. Defaults to Conway's rule
+ */
+extern char life_rule[2][9];
+
+/* available evolve kernels */
+extern const gol_kernel byte_kernel;
+extern const gol_kernel packed_kernel;
+extern const gol_kernel simd_kernel;
+extern const gol_kernel colsum_kernel;
+extern const gol_kernel lut_kernel;
+extern const gol_kernel tiles_kernel;
+extern const gol_kernel ltl_kernel;
+extern const gol_kernel sparse_kernel;
+
 /**
  * parse the input arguments
  * @param  argc             [input]  argument count
@@ -40,24 +214,233 @@ typedef struct {
  * @param  gsize            [output] size of the state space
  * @param  max_gens         [output] maximum number of generations
  * @param  output_filename  [output] output filename for bmp file
+ * @param  opts             [output] optional settings
  * @return 1 if OK, 0 otherwise
  */
-int parse_arguments(int argc, char *argv[], char **filename, int *gsize, int *max_gens, char **output_filename);
+int parse_arguments(int argc, char *argv[], char **filename, int *gsize, int *max_gens, char **output_filename, options * opts);
+
+/**
+ * print the command line usage
+ * @param prog program name
+ */
+void print_usage(const char * prog);
+
+/**
+ * select the evolve kernel for state `s`.
+ * Must be called once the initial state has been loaded into `s->space`
+ * @param  s    [input/output] state
+ * @param  opts settings, `opts->kernel` is the kernel name.
+ *              Must outlive the state.
+ * @return 1 if OK, 0 if the kernel does not exist or cannot be used
+ */
+int set_kernel(state * s, const options * opts);
+
+/**
+ * list the available evolve kernels
+ * @param  i index of the kernel
+ * @return   kernel i, NULL past the last one
+ */
+const gol_kernel * get_kernel(int i);
 
 /**
- * compute the next generation for state `s`
+ * pick the fastest kernel, tile edge and thread count for a state, timing
+ * a few generations of each on a copy of it, or reusing the cached choice
+ * for the same board shape. With MPI, it must be called by every rank.
+ * Call `set_kernel` afterwards
+ * @param  s    [input] state, with its initial board loaded
+ * @param  opts [input/output] settings, `opts->kernel`, `opts->tile` and
+ *              `opts->threads` are set to the fastest choice
+ * @return 1 if OK, 0 if no kernel can run the state
+ */
+int autotune(state * s, options * opts);
+
+/**
+ * set the threads and scheduling of the evolve loops, done by `set_kernel`
+ * @param opts settings, `opts->threads`, `opts->schedule` and `opts->chunk`
+ */
+void set_threads(const options * opts);
+
+/**
+ * bring `s->space` up to date with the kernel representation.
+ * Must be called before reading the whole space (output, display)
+ * @param s [input/output] state
+ */
+void sync_state(state * s);
+
+/**
+ * print the threads in use and the statistics of the kernel, if any
+ * @param s state
+ */
+void print_stats(state * s);
+
+/**
+ * get the vectorized row function for an instruction set and a rule
+ * @param  isa     instruction set, or "auto" for the fastest supported
+ * @param  birth   birth mask of the rule
+ * @param  survive survive mask of the rule
+ * @return         row function, or NULL if `isa` is not supported
+ */
+row_fn simd_row_fn(const char * isa, int birth, int survive);
+
+/**
+ * compute the next generation of a state with halos, row by row,
+ * including `s->margin` halo rows/columns around the grid.
+ * Wide rows are swept in column blocks of `s->opts->block` cells, so that
+ * the rows in use stay in cache.
+ * States without halos wrap around the edges, using `row` for all but
+ * the first and last columns
+ * @param  s    [input/output] current state to evolve
+ * @param  row  function computing a single row
+ * @return      checksum for generation transition
+ */
+long evolve_rows(state * s, row_fn row);
+
+/**
+ * compute the next generation for state `s` using the selected kernel,
+ * then swap `space` and `next`
  * @param  s     [input/output] current state to evolve
- * @param  snew  auxiliary state with same size as 's'
  * @return       checksum for generation transition
  */
 long evolve(state * s);
 
+/**
+ * compute the interior of the next generation, which does not read the
+ * halo, e.g. while halos are being exchanged. The kernel must support parts
+ * @param  s [input/output] state
+ */
+void evolve_interior(state * s);
+
+/**
+ * compute the rest of the generation started by `evolve_interior`, and
+ * complete it as `evolve`
+ * @param  s [input/output] state
+ * @return   number of cells changed in the whole generation
+ */
+long evolve_boundary(state * s);
+
+/**
+ * count the live grid cells of `s->space`
+ * @param  s     [input] state
+ * @return       number of live cells
+ */
+long count_population(state * s);
+
+/**
+ * set up cycle detection
+ * @param c      [output] cycle detection state
+ * @param window generations searched for cycles, 0 to disable
+ */
+void cycle_init(cycle_state * c, int window);
+
+/**
+ * free a cycle detection state
+ * @param c [input/output] cycle detection state
+ */
+void cycle_free(cycle_state * c);
+
+/**
+ * record the signature of a generation, in increasing order
+ * @param  c          [input/output] cycle detection state
+ * @param  generation generation number
+ * @param  changes    cells changed from the generation before (whole board)
+ * @param  population live cells (whole board)
+ * @param  local      cells changed in the local state, for `cycle_skip`
+ * @return            candidate period, 0 if none
+ */
+int cycle_update(cycle_state * c, long generation, long changes, long population, long local);
+
+/**
+ * the board must be hashed at this generation to confirm the candidate
+ * @param  c          [input] cycle detection state
+ * @param  generation current generation of the board
+ * @return            1 if `cycle_confirm` must be called
+ */
+int cycle_hash_due(const cycle_state * c, long generation);
+
+/**
+ * compare the board hash with the one of a period before
+ * @param  c          [input/output] cycle detection state
+ * @param  generation current generation of the board
+ * @param  hash       hash of the whole board, see `board_hash`
+ * @return            1 if the cycle is confirmed
+ */
+int cycle_confirm(cycle_state * c, long generation, uint64_t hash);
+
+/**
+ * skip whole cycles of a confirmed period
+ * @param  c           [input/output] cycle detection state
+ * @param  generations generations to skip, a multiple of the period
+ * @return             local checksum of the skipped generations
+ */
+long cycle_skip(cycle_state * c, long generations);
+
+/**
+ * print the cycle found, if detection is enabled
+ * @param c cycle detection state
+ */
+void cycle_report(const cycle_state * c);
+
+/**
+ * hash the grid of a state, after syncing it. The hashes of the blocks of a
+ * board add up to the hash of the whole board
+ * @param  s     [input/output] state
+ * @param  y0    global row of the first grid row
+ * @param  x0    global column of the first grid column
+ * @param  gcols columns of the whole board
+ * @return       hash of the grid
+ */
+uint64_t board_hash(state * s, long y0, long x0, long gcols);
+
+/**
+ * set up an empty ensemble of boards
+ * @param  e       [output] ensemble
+ * @param  rows    rows of every board
+ * @param  cols    columns of every board
+ * @param  opts    settings, for the rule and the threads
+ * @return         1 if OK, 0 if out of memory
+ */
+int ensemble_init(ensemble * e, int rows, int cols, const options * opts);
+
+/**
+ * free an ensemble
+ * @param e [input/output] ensemble
+ */
+void ensemble_free(ensemble * e);
+
+/**
+ * add a board to an ensemble
+ * @param  e     [input/output] ensemble
+ * @param  cells [input] rows x cols cells of the board, 0 or 1
+ * @return       index of the board, -1 if the ensemble is full
+ */
+int ensemble_add(ensemble * e, const char * cells);
+
+/**
+ * extract a board from an ensemble
+ * @param e     [input] ensemble
+ * @param b     index of the board
+ * @param cells [output] rows x cols cells of the board
+ */
+void ensemble_get(const ensemble * e, int b, char * cells);
+
+/**
+ * compute one generation of every board of an ensemble
+ * @param e [input/output] ensemble
+ */
+void ensemble_evolve(ensemble * e);
+
+/**
+ * wall clock time
+ * @return seconds since an arbitrary point in the past
+ */
+double wall_time(void);
+
 /**
  * allocates a new state
  * @param s    [output] allocated state
  * @param rows number of rows
  * @param cols number of columns
- * @param halo boolean. If TRUE, allocates extra halo rows/columns
+ * @param halo width of the extra halo rows/columns (0 for no halo)
  */
 void alloc_state(state * s, int rows, int cols, int halo);
 
@@ -106,4 +489,14 @@ void write_bmp_mpi(const char * filename, state * s, int * gsize, int * psize, M
  */
 void write_bmp(const char * filename, state * s);
 
-void write_bmp_seq_matrix(const char * filename, char ** space, int rows, int cols, int halo);
+/**
+ * Create a bmp file out of a plane
+ *
+ * @param filename output filename (.bmp)
+ * @param space    plane, halo included
+ * @param rows     number of rows
+ * @param cols     number of columns
+ * @param stride   bytes per plane row
+ * @param halo     halo rows/columns on each side
+ */
+void write_bmp_seq_matrix(const char * filename, const char * space, int rows, int cols, int stride, int halo);
@@ -0,0 +1,185 @@
+/*
+ * Cycle detection
+ *
+ * Every generation leaves a signature: the cells that changed and the
+ * population, which the kernels count anyway. A board cycling with period p
+ * repeats its signatures every p generations, so the signatures of a window
+ * of past generations point to the candidate periods for free. A candidate
+ * is confirmed by hashing the whole board twice, p generations apart; if the
+ * hashes differ (e.g., a blinker repeats its signature every generation),
+ * longer periods are tried next.
+ *
+ * The cycle begins at the first generation of the window from which the
+ * signatures repeat with the period, the earliest one the board may have
+ * started repeating.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "gol_common.h"
+
+#define MIN(a,b) (a<b?a:b)
+
+/* signature slot of a generation */
+#define SLOT(c, g) ((g) % (c)->window)
+
+void cycle_init(cycle_state * c, int window)
+{
+  c->window = window;
+  c->changes = window ? (long *) calloc(window, sizeof(long)) : NULL;
+  c->population = window ? (long *) calloc(window, sizeof(long)) : NULL;
+  c->local = window ? (long *) calloc(window, sizeof(long)) : NULL;
+  c->last = -1;
+  c->recorded = 0;
+  c->period = 0;
+  c->min_period = 1;
+  c->ref_generation = -1;
+  c->ref_hash = 0;
+  c->start = -1;
+  c->found = -1;
+  c->skipped = 0;
+}
+
+void cycle_free(cycle_state * c)
+{
+  free(c->changes);
+  free(c->population);
+  free(c->local);
+}
+
+/* signatures of generations g and g - p are equal */
+static inline int repeats(const cycle_state * c, long g, int p)
+{
+  return c->changes[SLOT(c, g)] == c->changes[SLOT(c, g - p)] &&
+         c->population[SLOT(c, g)] == c->population[SLOT(c, g - p)];
+}
+
+int cycle_update(cycle_state * c, long generation, long changes, long population, long local)
+{
+  if (!c->window || c->found >= 0)
+    return 0;
+
+  c->changes[SLOT(c, generation)] = changes;
+  c->population[SLOT(c, generation)] = population;
+  c->local[SLOT(c, generation)] = local;
+  c->last = generation;
+  ++c->recorded;
+
+  /* the candidate period still holds */
+  if (c->period && repeats(c, generation, c->period))
+    return c->period;
+
+  /* otherwise, look for the shortest period repeated over a whole period */
+  c->period = 0;
+  c->ref_generation = -1;
+  for (int p = c->min_period; 2*p <= c->recorded && 2*p <= c->window; ++p)
+  {
+    int i = 0;
+    while (i < p && repeats(c, generation - i, p))
+      ++i;
+    if (i == p)
+    {
+      c->period = p;
+      break;
+    }
+  }
+  if (!c->period)
+    c->min_period = 1;
+  return c->period;
+}
+
+int cycle_hash_due(const cycle_state * c, long generation)
+{
+  return c->period && c->found < 0 &&
+         (c->ref_generation < 0 || generation - c->ref_generation >= c->period);
+}
+
+int cycle_confirm(cycle_state * c, long generation, uint64_t hash)
+{
+  if (c->ref_generation >= 0 && generation - c->ref_generation == c->period &&
+      hash == c->ref_hash)
+  {
+    long g = generation;
+
+    /* earliest generation in the window repeating with the period */
+    while (g - c->period > c->last - c->recorded + 1 && g - c->period > c->last - c->window + 1 &&
+           repeats(c, g - 1, c->period))
+      --g;
+    /* the signature of g covers the change from generation g-1 */
+    c->start = g - c->period - 1;
+    c->found = generation;
+    return 1;
+  }
+
+  if (c->ref_generation >= 0 && generation - c->ref_generation == c->period)
+  {
+    /* the board did not repeat: try longer periods */
+    c->min_period = c->period + 1;
+    c->period = 0;
+    c->ref_generation = -1;
+    return 0;
+  }
+
+  c->ref_generation = generation;
+  c->ref_hash = hash;
+  return 0;
+}
+
+long cycle_skip(cycle_state * c, long generations)
+{
+  long cycles = generations / c->period, checksum = 0;
+
+  /* local changes of the last period, repeated by every skipped cycle */
+  for (long g = c->last - c->period + 1; g <= c->last; ++g)
+    checksum += c->local[SLOT(c, g)];
+  c->skipped += cycles * c->period;
+  return cycles * checksum;
+}
+
+void cycle_report(const cycle_state * c)
+{
+  if (!c->window)
+    return;
+  if (c->found < 0)
+  {
+    printf("  Cycle: none found (window of %d generations)\n", c->window);
+    return;
+  }
+  printf("  Cycle: period %d from generation %ld, detected at generation %ld\n",
+         c->period, c->start, c->found);
+  if (c->skipped)
+    printf("  Generations skipped: %ld\n", c->skipped);
+}
+
+/* 64-bit finalizer of splitmix64 */
+static inline uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+uint64_t board_hash(state * s, long y0, long x0, long gcols)
+{
+  uint64_t hash = 0;
+
+  sync_state(s);
+
+  #pragma omp parallel for schedule(runtime) reduction(+:hash)
+  for (int y = 0; y < s->rows; ++y)
+  {
+    const char * row = SPACE_ROW(s, y + s->halo) + s->halo;
+    uint64_t index = (uint64_t) (y0 + y) * gcols + x0;
+
+    /* words of 8 cells, tagged with the global index of their first cell */
+    for (int x = 0; x < s->cols; x += 8)
+    {
+      uint64_t word = 0;
+      memcpy(&word, row + x, MIN(8, s->cols - x));
+      hash += mix64(word ^ mix64(index + x));
+    }
+  }
+  return hash;
+}
@@ -0,0 +1,278 @@
+/*
+ * Bit-sliced ensemble of boards
+ *
+ * Up to ENSEMBLE_MAX boards of the same size are evolved at once: bit b of
+ * the word at a cell position is the cell of board b, and the neighbor
+ * counts of all the boards are computed together with bitwise full adders.
+ * Changed and live cells are added up in bit-sliced counters too, and split
+ * into per-board counts once per generation. Common rules get their own rows
+ * with the rule folded in, as in gol_simd.c.
+ *
+ * Boards wrap around their edges, through a 1 cell halo refreshed every
+ * generation.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "gol_common.h"
+
+#define ENSEMBLE_ROW(e, p, y) ((p) + (size_t)(y) * ((e)->cols + 2))
+
+int ensemble_init(ensemble * e, int rows, int cols, const options * opts)
+{
+  set_threads(opts);
+
+  e->rows = rows;
+  e->cols = cols;
+  e->boards = 0;
+  e->birth = opts->birth;
+  e->survive = opts->survive;
+  e->generation = 0;
+  memset(e->checksum, 0, sizeof(e->checksum));
+  memset(e->population, 0, sizeof(e->population));
+  e->plane = (uint64_t *) calloc((size_t)(rows + 2) * (cols + 2), sizeof(uint64_t));
+  e->next = (uint64_t *) calloc((size_t)(rows + 2) * (cols + 2), sizeof(uint64_t));
+  return e->plane && e->next;
+}
+
+void ensemble_free(ensemble * e)
+{
+  free(e->plane);
+  free(e->next);
+}
+
+int ensemble_add(ensemble * e, const char * cells)
+{
+  int b = e->boards;
+
+  if (b == ENSEMBLE_MAX)
+    return -1;
+
+  e->population[b] = 0;
+  for (int y = 0; y < e->rows; ++y)
+  {
+    uint64_t * row = ENSEMBLE_ROW(e, e->plane, y + 1) + 1;
+    for (int x = 0; x < e->cols; ++x)
+    {
+      row[x] |= (uint64_t) (cells[(size_t) y * e->cols + x] != 0) << b;
+      e->population[b] += cells[(size_t) y * e->cols + x] != 0;
+    }
+  }
+  return e->boards++;
+}
+
+void ensemble_get(const ensemble * e, int b, char * cells)
+{
+  for (int y = 0; y < e->rows; ++y)
+  {
+    const uint64_t * row = ENSEMBLE_ROW(e, e->plane, y + 1) + 1;
+    for (int x = 0; x < e->cols; ++x)
+      cells[(size_t) y * e->cols + x] = (row[x] >> b) & 1;
+  }
+}
+
+/* wrap the boards around into the halo */
+static void wrap_halo(ensemble * e)
+{
+  int h = e->rows, w = e->cols;
+
+  memcpy(ENSEMBLE_ROW(e, e->plane, 0) + 1, ENSEMBLE_ROW(e, e->plane, h) + 1, w * sizeof(uint64_t));
+  memcpy(ENSEMBLE_ROW(e, e->plane, h+1) + 1, ENSEMBLE_ROW(e, e->plane, 1) + 1, w * sizeof(uint64_t));
+  for (int y = 0; y <= h+1; ++y)
+  {
+    uint64_t * row = ENSEMBLE_ROW(e, e->plane, y);
+    row[0] = row[w];
+    row[w+1] = row[1];
+  }
+}
+
+/* the sum may be written over an input */
+#define FULL_ADD(a, b, c, s, carry) { uint64_t t = (a) ^ (b), u = ((a) & (b)) | (t & (c)); s = t ^ (c); carry = u; }
+#define HALF_ADD(a, b, s, carry)    { s = (a) ^ (b); carry = (a) & (b); }
+
+/*
+ * bit-sliced counter: bit b of level[l] is bit l of the count of board b.
+ * Words are first added with carry-save adders into ones, twos and fours,
+ * and only the eights are rippled through the levels
+ */
+typedef struct {
+  uint64_t ones, twos, fours;
+  uint64_t level[64];
+} bit_counter;
+
+/* add a bit per board to the levels of a counter, from level l */
+static inline void count_add(bit_counter * c, int l, uint64_t bits)
+{
+  for (; bits; ++l)
+  {
+    uint64_t carry = c->level[l] & bits;
+    c->level[l] ^= bits;
+    bits = carry;
+  }
+}
+
+/* add the bits of n words to a counter */
+static void count_words(bit_counter * c, const uint64_t * w, int n)
+{
+  uint64_t twos_a, twos_b, fours_a, fours_b, eights;
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8)
+  {
+    FULL_ADD(c->ones, w[i],   w[i+1], c->ones, twos_a);
+    FULL_ADD(c->ones, w[i+2], w[i+3], c->ones, twos_b);
+    FULL_ADD(c->twos, twos_a, twos_b, c->twos, fours_a);
+    FULL_ADD(c->ones, w[i+4], w[i+5], c->ones, twos_a);
+    FULL_ADD(c->ones, w[i+6], w[i+7], c->ones, twos_b);
+    FULL_ADD(c->twos, twos_a, twos_b, c->twos, fours_b);
+    FULL_ADD(c->fours, fours_a, fours_b, c->fours, eights);
+    count_add(c, 3, eights);
+  }
+  for (; i < n; ++i)
+    count_add(c, 0, w[i]);
+}
+
+/* add a counter to per-board counts */
+static void count_flush(bit_counter * c, long * counts)
+{
+  count_add(c, 0, c->ones);
+  count_add(c, 1, c->twos);
+  count_add(c, 2, c->fours);
+  for (int l = 0; l < 64; ++l)
+    for (int b = 0; b < ENSEMBLE_MAX; ++b)
+      counts[b] += (long) ((c->level[l] >> b) & 1) << l;
+}
+
+/*
+ * Next state of 64 cells. The 8 neighbors are added into the count bits
+ * n0-n3; the boards of a cell with k neighbors are selected by matching
+ * the count bits with k
+ */
+static inline __attribute__((always_inline))
+uint64_t ensemble_cell(const uint64_t * up, const uint64_t * mid, const uint64_t * down,
+                       int x, int birth, int survive)
+{
+  uint64_t s0, c0, s1, c1, s2, c2, n0, c3, t0, t1, n1, t2, n2, n3;
+
+  FULL_ADD(up[x-1], up[x], up[x+1], s0, c0);
+  FULL_ADD(mid[x-1], mid[x+1], down[x-1], s1, c1);
+  HALF_ADD(down[x], down[x+1], s2, c2);
+  FULL_ADD(s0, s1, s2, n0, c3);
+  FULL_ADD(c0, c1, c2, t0, t1);
+  HALF_ADD(t0, c3, n1, t2);
+  HALF_ADD(t1, t2, n2, n3);
+
+  uint64_t alive = mid[x], r = 0;
+  for (int k = 0; k <= 8; ++k)
+  {
+    if (!((birth | survive) >> k & 1))
+      continue;
+    uint64_t eq = (k & 1 ? n0 : ~n0) & (k & 2 ? n1 : ~n1) &
+                  (k & 4 ? n2 : ~n2) & (k & 8 ? n3 : ~n3);
+    if (birth >> k & 1)
+      r |= eq & ~alive;
+    if (survive >> k & 1)
+      r |= eq & alive;
+  }
+  return r;
+}
+
+typedef void (*ensemble_row_fn)(const uint64_t * up, const uint64_t * mid, const uint64_t * down,
+                                uint64_t * out, uint64_t * changed, int n, int birth, int survive);
+
+/* a row of cells, and the cells changed from `mid` */
+static inline __attribute__((always_inline))
+void ensemble_row_rule(const uint64_t * up, const uint64_t * mid, const uint64_t * down,
+                       uint64_t * out, uint64_t * changed, int n, int birth, int survive)
+{
+  for (int x = 1; x <= n; ++x)
+  {
+    out[x] = ensemble_cell(up, mid, down, x, birth, survive);
+    changed[x] = out[x] ^ mid[x];
+  }
+}
+
+/* rows for any rule, and rows with the rule folded in for the common ones */
+static void ensemble_row_any(const uint64_t * up, const uint64_t * mid, const uint64_t * down,
+                             uint64_t * out, uint64_t * changed, int n, int birth, int survive)
+{
+  ensemble_row_rule(up, mid, down, out, changed, n, birth, survive);
+}
+
+#define ENSEMBLE_ROWS(name, birth, survive) \
+  static void ensemble_row_##name(const uint64_t * up, const uint64_t * mid, const uint64_t * down, \
+                                  uint64_t * out, uint64_t * changed, int n, int b, int s) \
+  { ensemble_row_rule(up, mid, down, out, changed, n, birth, survive); }
+
+ENSEMBLE_ROWS(conway,   RULE_CONWAY_B,   RULE_CONWAY_S)
+ENSEMBLE_ROWS(highlife, RULE_HIGHLIFE_B, RULE_HIGHLIFE_S)
+ENSEMBLE_ROWS(daynight, RULE_DAYNIGHT_B, RULE_DAYNIGHT_S)
+ENSEMBLE_ROWS(seeds,    RULE_SEEDS_B,    RULE_SEEDS_S)
+
+static const struct {
+  int birth, survive;
+  ensemble_row_fn row;
+} ensemble_rules[] = {
+  {RULE_CONWAY_B,   RULE_CONWAY_S,   ensemble_row_conway},
+  {RULE_HIGHLIFE_B, RULE_HIGHLIFE_S, ensemble_row_highlife},
+  {RULE_DAYNIGHT_B, RULE_DAYNIGHT_S, ensemble_row_daynight},
+  {RULE_SEEDS_B,    RULE_SEEDS_S,    ensemble_row_seeds},
+  {-1, -1, ensemble_row_any}
+};
+
+void ensemble_evolve(ensemble * e)
+{
+  int h = e->rows, w = e->cols, birth = e->birth, survive = e->survive, r = 0;
+  long checksum[ENSEMBLE_MAX] = {0}, population[ENSEMBLE_MAX] = {0};
+
+  while (ensemble_rules[r].birth >= 0 &&
+         (ensemble_rules[r].birth != birth || ensemble_rules[r].survive != survive))
+    ++r;
+  ensemble_row_fn row = ensemble_rules[r].row;
+
+  wrap_halo(e);
+
+  #pragma omp parallel
+  {
+    bit_counter * changed = (bit_counter *) calloc(1, sizeof(bit_counter)),
+                * live = (bit_counter *) calloc(1, sizeof(bit_counter));
+    uint64_t * diff = (uint64_t *) malloc((w + 2) * sizeof(uint64_t));
+    long lchecksum[ENSEMBLE_MAX] = {0}, lpopulation[ENSEMBLE_MAX] = {0};
+
+    #pragma omp for schedule(runtime)
+    for (int y = 1; y <= h; ++y)
+    {
+      uint64_t * out = ENSEMBLE_ROW(e, e->next, y);
+
+      row(ENSEMBLE_ROW(e, e->plane, y-1), ENSEMBLE_ROW(e, e->plane, y), ENSEMBLE_ROW(e, e->plane, y+1),
+          out, diff, w, birth, survive);
+      count_words(changed, diff + 1, w);
+      count_words(live, out + 1, w);
+    }
+
+    count_flush(changed, lchecksum);
+    count_flush(live, lpopulation);
+    #pragma omp critical
+    for (int b = 0; b < ENSEMBLE_MAX; ++b)
+    {
+      checksum[b] += lchecksum[b];
+      population[b] += lpopulation[b];
+    }
+    free(changed);
+    free(live);
+    free(diff);
+  }
+
+  for (int b = 0; b < e->boards; ++b)
+  {
+    e->checksum[b] += checksum[b];
+    e->population[b] = population[b];
+  }
+
+  uint64_t * tmp = e->plane;
+  e->plane = e->next;
+  e->next = tmp;
+  e->generation++;
+}
@@ -0,0 +1,142 @@
+/*
+ * Larger than Life evolve kernel
+ *
+ * Cells look at every neighbor within radius R (a (2R+1)x(2R+1) Moore
+ * neighborhood). Neighbor counts come from a summed-area table of the
+ * current plane, so each cell costs 4 lookups whatever the radius:
+ *   count(y, x) = I[y+R+1][x+R+1] - I[y-R][x+R+1] - I[y+R+1][x-R] + I[y-R][x-R]
+ * where I[y][x] is the number of live cells above and left of (y, x).
+ *
+ * The table covers the whole plane, halo included, and is kept in unsigned
+ * 32-bit words: sums may wrap around on huge boards, but their differences
+ * (the window counts) are still exact.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "gol_common.h"
+
+typedef struct {
+  int width;          /* table entries per row */
+  uint32_t * sum;     /* summed-area table, (rows + 2*halo + 1) x width */
+} ltl_state;
+
+#define SUM_ROW(ls, y) ((ls)->sum + (size_t)(y) * (ls)->width)
+
+static int init_ltl(state * s)
+{
+  ltl_state * ls;
+
+  if (!s->halo)
+  {
+    fprintf(stderr, "Error: ltl kernel requires a state with halos\n");
+    return 0;
+  }
+
+  ls = (ltl_state *) malloc(sizeof(ltl_state));
+  ls->width = s->cols + 2*s->halo + 1;
+  /* row 0 and column 0 of the table stay 0 */
+  ls->sum = (uint32_t *) calloc((size_t)(s->rows + 2*s->halo + 1) * ls->width, sizeof(uint32_t));
+  s->kdata = ls;
+
+  return 1;
+}
+
+/* fill the summed-area table with the current plane */
+static void build_table(state * s, ltl_state * ls)
+{
+  int ny = s->rows + 2*s->halo,
+      nx = s->cols + 2*s->halo;
+
+  /* prefix sums along every row */
+  #pragma omp parallel for schedule(runtime)
+  for (int y = 0; y < ny; ++y)
+  {
+    const char * in = SPACE_ROW(s, y);
+    uint32_t * out = SUM_ROW(ls, y+1), acc = 0;
+    for (int x = 0; x < nx; ++x)
+    {
+      acc += in[x];
+      out[x+1] = acc;
+    }
+  }
+
+  /* then down the columns */
+  for (int y = 2; y <= ny; ++y)
+  {
+    const uint32_t * above = SUM_ROW(ls, y-1);
+    uint32_t * out = SUM_ROW(ls, y);
+    for (int x = 1; x <= nx; ++x)
+      out[x] += above[x];
+  }
+}
+
+static long evolve_ltl(state * s)
+{
+  const options * opts = s->opts;
+  ltl_state * ls = (ltl_state *) s->kdata;
+  long checksum = 0, population = 0;
+  int halo   = s->halo,
+      h      = s->rows,
+      w      = s->cols,
+      m      = s->margin,
+      r      = s->radius,
+      middle = opts->middle;
+  /* ranges as (min, max - min), tested with a single unsigned comparison */
+  uint32_t bmin = opts->birth_min, bspan = opts->birth_max - opts->birth_min,
+           smin = opts->survive_min, sspan = opts->survive_max - opts->survive_min;
+
+  assert(m <= halo - r);
+
+  build_table(s, ls);
+
+  #pragma omp parallel for schedule(runtime) reduction(+:checksum,population)
+  for (int y = halo-m; y < h+halo+m; y++)
+  {
+    int inner = y >= halo && y < h+halo;
+    const uint32_t * top = SUM_ROW(ls, y-r),
+                   * bottom = SUM_ROW(ls, y+r+1);
+    const char * in = SPACE_ROW(s, y);
+    char * out = NEXT_ROW(s, y);
+    long changes = 0, live = 0;
+
+    for (int x = halo-m; x < w+halo+m; x++)
+    {
+      uint32_t alive = in[x],
+               n = bottom[x+r+1] - top[x+r+1] - bottom[x-r] + top[x-r] - (middle ? 0 : alive),
+               born = n - bmin <= bspan,
+               survives = n - smin <= sspan;
+      char cell = alive ? survives : born;
+
+      out[x] = cell;
+      /* margin cells are not part of the checksum */
+      if (inner && x >= halo && x < w+halo)
+      {
+        changes += cell != in[x];
+        live += cell;
+      }
+    }
+    checksum += changes;
+    population += live;
+  }
+
+  s->population = population;
+  return checksum;
+}
+
+static void release_ltl(state * s)
+{
+  ltl_state * ls = (ltl_state *) s->kdata;
+
+  if (!ls)
+    return;
+
+  free(ls->sum);
+  free(ls);
+  s->kdata = NULL;
+}
+
+const gol_kernel ltl_kernel = {"ltl", init_ltl, evolve_ltl, NULL, release_ltl, NULL, 1, 0, 1};
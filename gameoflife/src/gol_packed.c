@@ -0,0 +1,218 @@
+/*
+ * Bit-packed evolve kernel
+ *
+ * The board is stored with 64 cells per uint64_t word, and the neighbor
+ * counts of 64 cells are computed at once with bitwise full-adder logic.
+ *
+ * The packed board always has one halo row/column on each side, so that the
+ * packed column x matches the space column x when the state has halos.
+ * Packed rows are padded to whole words; padding and halo bits of computed
+ * rows are kept to 0.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "gol_common.h"
+
+typedef struct {
+  int words;          /* words per packed row */
+  uint64_t * plane;   /* current board */
+  uint64_t * next;    /* board for the next generation */
+  uint64_t * mask;    /* interior bits of each word in a row */
+} packed_board;
+
+#define PACKED_ROW(pb, p, y) ((p) + (size_t)(y) * (pb)->words)
+
+static inline int get_bit(const uint64_t * row, int x)
+{
+  return (row[x >> 6] >> (x & 63)) & 1;
+}
+
+static inline void set_bit(uint64_t * row, int x, int v)
+{
+  uint64_t m = (uint64_t) 1 << (x & 63);
+  row[x >> 6] = v ? (row[x >> 6] | m) : (row[x >> 6] & ~m);
+}
+
+/* plane row for packed row `y`; packed column x is plane column x-offset */
+static inline char * plane_row(state * s, char * plane, int y)
+{
+  return PLANE_ROW(plane, s->stride, y - 1 + s->halo) - 1 + s->halo;
+}
+
+/* pack space cells [x0, x1] of packed row y */
+static void pack_cells(state * s, uint64_t * row, int y, int x0, int x1)
+{
+  char * src = plane_row(s, s->space, y);
+  for (int x = x0; x <= x1; ++x)
+    set_bit(row, x, src[x] != 0);
+}
+
+/* unpack cells [x0, x1] of packed row y into a plane of the state */
+static void unpack_cells(state * s, char * plane, const uint64_t * row, int y, int x0, int x1)
+{
+  char * dst = plane_row(s, plane, y);
+  for (int x = x0; x <= x1; ++x)
+    dst[x] = get_bit(row, x);
+}
+
+/*
+ * Fill the packed halo: from the space halo if present, otherwise wrapping
+ * around the packed board itself
+ */
+static void import_halo(state * s, packed_board * pb)
+{
+  int h = s->rows, w = s->cols;
+  uint64_t * p = pb->plane;
+
+  if (s->halo)
+  {
+    pack_cells(s, PACKED_ROW(pb, p, 0), 0, 0, w+1);
+    pack_cells(s, PACKED_ROW(pb, p, h+1), h+1, 0, w+1);
+    for (int y = 1; y <= h; ++y)
+    {
+      uint64_t * row = PACKED_ROW(pb, p, y);
+      set_bit(row, 0, SPACE(s, y, 0) != 0);
+      set_bit(row, w+1, SPACE(s, y, w+1) != 0);
+    }
+  }
+  else
+  {
+    memcpy(PACKED_ROW(pb, p, 0), PACKED_ROW(pb, p, h), pb->words * sizeof(uint64_t));
+    memcpy(PACKED_ROW(pb, p, h+1), PACKED_ROW(pb, p, 1), pb->words * sizeof(uint64_t));
+    for (int y = 0; y <= h+1; ++y)
+    {
+      uint64_t * row = PACKED_ROW(pb, p, y);
+      set_bit(row, 0, get_bit(row, w));
+      set_bit(row, w+1, get_bit(row, 1));
+    }
+  }
+}
+
+/*
+ * write bounding rows and columns to the next plane of the state, which
+ * becomes `space` after the generation, for halo exchange
+ */
+static void export_bounds(state * s, packed_board * pb)
+{
+  int h = s->rows, w = s->cols;
+
+  unpack_cells(s, s->next, PACKED_ROW(pb, pb->plane, 1), 1, 1, w);
+  unpack_cells(s, s->next, PACKED_ROW(pb, pb->plane, h), h, 1, w);
+  for (int y = 2; y < h; ++y)
+  {
+    const uint64_t * row = PACKED_ROW(pb, pb->plane, y);
+    NEXT(s, y, 1) = get_bit(row, 1);
+    NEXT(s, y, w) = get_bit(row, w);
+  }
+}
+
+static int init_packed(state * s)
+{
+  packed_board * pb = (packed_board *) malloc(sizeof(packed_board));
+  int w = s->cols;
+
+  pb->words = (w + 2 + 63) / 64;
+  pb->plane = (uint64_t *) calloc((size_t)(s->rows + 2) * pb->words, sizeof(uint64_t));
+  pb->next  = (uint64_t *) calloc((size_t)(s->rows + 2) * pb->words, sizeof(uint64_t));
+  pb->mask  = (uint64_t *) calloc(pb->words, sizeof(uint64_t));
+  for (int x = 1; x <= w; ++x)
+    set_bit(pb->mask, x, 1);
+
+  for (int y = 1; y <= s->rows; ++y)
+    pack_cells(s, PACKED_ROW(pb, pb->plane, y), y, 1, w);
+
+  s->kdata = pb;
+  return 1;
+}
+
+/*
+ * 64 cells at once. Sums of the 3 upper, 2 middle and 3 lower neighbors are
+ * computed with full/half adders, then the weight-2 carries are combined:
+ *   n = ones + 2*(u2 + m2 + d2 + o2)
+ * The cell lives if the weight-2 sum is exactly 1 and (ones or alive),
+ * i.e., n == 3 or (n == 2 and alive).
+ */
+static inline uint64_t life_word(uint64_t ul, uint64_t u, uint64_t ur,
+                                 uint64_t ml, uint64_t m, uint64_t mr,
+                                 uint64_t dl, uint64_t d, uint64_t dr)
+{
+  uint64_t u1 = ul ^ u ^ ur,
+           u2 = (ul & u) | (ur & (ul ^ u)),
+           d1 = dl ^ d ^ dr,
+           d2 = (dl & d) | (dr & (dl ^ d)),
+           m1 = ml ^ mr,
+           m2 = ml & mr;
+  uint64_t o1 = u1 ^ d1 ^ m1,
+           o2 = (u1 & d1) | (m1 & (u1 ^ d1));
+  uint64_t x1 = u2 ^ d2, y1 = u2 & d2,
+           x2 = m2 ^ o2, y2 = m2 & o2;
+
+  return (x1 ^ x2) & ~(y1 | y2) & (o1 | m);
+}
+
+/* cells x-1 and x+1 into bit x, taking the carries from adjacent words */
+#define SHL(r, i)    (((r)[i] << 1) | ((i) ? (r)[(i)-1] >> 63 : 0))
+#define SHR(r, i, n) (((r)[i] >> 1) | ((i) < (n)-1 ? (r)[(i)+1] << 63 : 0))
+
+static long evolve_packed(state * s)
+{
+  packed_board * pb = (packed_board *) s->kdata;
+  int n = pb->words;
+  long checksum = 0, population = 0;
+
+  import_halo(s, pb);
+
+  #pragma omp parallel for schedule(runtime) reduction(+:checksum,population)
+  for (int y = 1; y <= s->rows; ++y)
+  {
+    const uint64_t * up  = PACKED_ROW(pb, pb->plane, y-1),
+                   * mid = PACKED_ROW(pb, pb->plane, y),
+                   * dn  = PACKED_ROW(pb, pb->plane, y+1);
+    uint64_t * out = PACKED_ROW(pb, pb->next, y);
+
+    for (int i = 0; i < n; ++i)
+    {
+      uint64_t cell = life_word(SHL(up, i), up[i], SHR(up, i, n),
+                                SHL(mid, i), mid[i], SHR(mid, i, n),
+                                SHL(dn, i), dn[i], SHR(dn, i, n)) & pb->mask[i];
+      checksum += __builtin_popcountll(cell ^ (mid[i] & pb->mask[i]));
+      population += __builtin_popcountll(cell);
+      out[i] = cell;
+    }
+  }
+
+  uint64_t * tmp = pb->plane;
+  pb->plane = pb->next;
+  pb->next = tmp;
+
+  if (s->halo)
+    export_bounds(s, pb);
+
+  s->population = population;
+  return checksum;
+}
+
+static void sync_packed(state * s)
+{
+  packed_board * pb = (packed_board *) s->kdata;
+
+  for (int y = 1; y <= s->rows; ++y)
+    unpack_cells(s, s->space, PACKED_ROW(pb, pb->plane, y), y, 1, s->cols);
+}
+
+static void release_packed(state * s)
+{
+  packed_board * pb = (packed_board *) s->kdata;
+
+  free(pb->plane);
+  free(pb->next);
+  free(pb->mask);
+  free(pb);
+  s->kdata = NULL;
+}
+
+const gol_kernel packed_kernel = {"packed", init_packed, evolve_packed, sync_packed, release_packed};
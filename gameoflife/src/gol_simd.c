@@ -0,0 +1,407 @@
+/*
+ * Vectorized evolve kernel for the byte layout
+ *
+ * Each row is computed by summing the three shifted upper, middle and lower
+ * rows with byte-lane adds (the 3x3 sum including the cell itself is at most
+ * 9, so it fits in a byte). For Conway's rule, a cell lives if the sum is 3,
+ * or 4 and the cell is alive.
+ *
+ * The row function is selected at startup from the instruction sets
+ * supported by the CPU, falling back to a scalar implementation, and from
+ * the rule: common rules have their own instances of the row templates,
+ * other rules look the next state up in a table.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gol_common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#else
+#define HAVE_X86 0
+#endif
+
+/*
+ * Row templates for a rule with compile-time masks: bit k of `birth` and
+ * `survive` is set if a dead cell is born, resp. a live cell survives, with
+ * k live neighbors. The masks are constant in every instance, so the tests
+ * over k fold into the few comparisons needed by the rule.
+ */
+#define RULE_ROW_TEMPLATE static inline __attribute__((always_inline))
+
+RULE_ROW_TEMPLATE long row_scalar_rule(const char * up, const char * mid, const char * down, char * out, int n,
+                                       long * population, const int birth, const int survive)
+{
+  long checksum = 0, live = 0;
+
+  for (int x = 0; x < n; ++x)
+  {
+    int c = up[x-1] + up[x] + up[x+1] +
+            mid[x-1] + mid[x+1] +
+            down[x-1] + down[x] + down[x+1];
+    int r = 0;
+    #pragma GCC unroll 9
+    for (int k = 0; k <= 8; ++k)
+    {
+      if ((birth & survive) >> k & 1)
+        r |= c == k;
+      else if (birth >> k & 1)
+        r |= (c == k) & !mid[x];
+      else if (survive >> k & 1)
+        r |= (c == k) & mid[x];
+    }
+    out[x] = r;
+    checksum += out[x] != mid[x];
+    live += out[x];
+  }
+  *population += live;
+  return checksum;
+}
+
+/* table-driven row for any other rule, see `life_rule` */
+static long row_scalar_table(const char * up, const char * mid, const char * down, char * out, int n, long * population)
+{
+  long checksum = 0, live = 0;
+
+  for (int x = 0; x < n; ++x)
+  {
+    int c = up[x-1] + up[x] + up[x+1] +
+            mid[x-1] + mid[x+1] +
+            down[x-1] + down[x] + down[x+1];
+    out[x] = life_rule[(int) mid[x]][c];
+    checksum += out[x] != mid[x];
+    live += out[x];
+  }
+  *population += live;
+  return checksum;
+}
+
+#if(HAVE_X86)
+
+#define LOAD3(T, load, add, p) add(add(load((const T *) ((p)-1)), load((const T *) (p))), load((const T *) ((p)+1)))
+
+/*
+ * Changed and live cells (0 or 1 bytes) are counted in byte lanes for up to
+ * COUNT_CHUNK vectors, then summed into 64-bit lanes with SAD. Row counts
+ * fit in 32 bits, so the low half of the lane sums is enough.
+ */
+#define COUNT_CHUNK 255
+#define HSUM128(v) _mm_cvtsi128_si32(_mm_add_epi64(v, _mm_unpackhi_epi64(v, v)))
+#define HSUM256(v) HSUM128(_mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)))
+
+/*
+ * The vector templates work on the 3x3 sum t including the cell itself:
+ * a dead cell with k neighbors has t == k, a live one t == k+1
+ */
+#define BORN_AT(t)    ((t) <= 8 && (birth >> (t) & 1))
+#define SURVIVE_AT(t) ((t) >= 1 && (survive >> ((t)-1) & 1))
+
+__attribute__((target("sse2,popcnt")))
+RULE_ROW_TEMPLATE long row_sse2_rule(const char * up, const char * mid, const char * down, char * out, int n,
+                                     long * population, const int birth, const int survive)
+{
+  const __m128i one = _mm_set1_epi8(1), zero = _mm_setzero_si128();
+  __m128i changed = zero, live = zero;
+  int x = 0;
+
+  while (x + 16 <= n)
+  {
+    __m128i bchanged = zero, blive = zero;
+    for (int i = 0; i < COUNT_CHUNK && x + 16 <= n; ++i, x += 16)
+    {
+      __m128i t = _mm_add_epi8(_mm_add_epi8(LOAD3(__m128i, _mm_loadu_si128, _mm_add_epi8, up + x),
+                                            LOAD3(__m128i, _mm_loadu_si128, _mm_add_epi8, mid + x)),
+                               LOAD3(__m128i, _mm_loadu_si128, _mm_add_epi8, down + x));
+      __m128i c = _mm_loadu_si128((const __m128i *) (mid + x));
+      __m128i r = _mm_setzero_si128();
+      #pragma GCC unroll 10
+      for (int k = 0; k <= 9; ++k)
+      {
+        __m128i eq = _mm_cmpeq_epi8(t, _mm_set1_epi8(k));
+        if (BORN_AT(k) && SURVIVE_AT(k))
+          r = _mm_or_si128(r, _mm_and_si128(eq, one));
+        else if (BORN_AT(k))
+          r = _mm_or_si128(r, _mm_and_si128(eq, _mm_xor_si128(c, one)));
+        else if (SURVIVE_AT(k))
+          r = _mm_or_si128(r, _mm_and_si128(eq, c));
+      }
+      _mm_storeu_si128((__m128i *) (out + x), r);
+      bchanged = _mm_add_epi8(bchanged, _mm_xor_si128(r, c));
+      blive = _mm_add_epi8(blive, r);
+    }
+    changed = _mm_add_epi64(changed, _mm_sad_epu8(bchanged, zero));
+    live = _mm_add_epi64(live, _mm_sad_epu8(blive, zero));
+  }
+  *population += HSUM128(live);
+  return HSUM128(changed) + row_scalar_rule(up + x, mid + x, down + x, out + x, n - x, population, birth, survive);
+}
+
+__attribute__((target("avx2,popcnt")))
+RULE_ROW_TEMPLATE long row_avx2_rule(const char * up, const char * mid, const char * down, char * out, int n,
+                                     long * population, const int birth, const int survive)
+{
+  const __m256i one = _mm256_set1_epi8(1), zero = _mm256_setzero_si256();
+  __m256i changed = zero, live = zero;
+  int x = 0;
+
+  while (x + 32 <= n)
+  {
+    __m256i bchanged = zero, blive = zero;
+    for (int i = 0; i < COUNT_CHUNK && x + 32 <= n; ++i, x += 32)
+    {
+      __m256i t = _mm256_add_epi8(_mm256_add_epi8(LOAD3(__m256i, _mm256_loadu_si256, _mm256_add_epi8, up + x),
+                                                  LOAD3(__m256i, _mm256_loadu_si256, _mm256_add_epi8, mid + x)),
+                                  LOAD3(__m256i, _mm256_loadu_si256, _mm256_add_epi8, down + x));
+      __m256i c = _mm256_loadu_si256((const __m256i *) (mid + x));
+      __m256i r = _mm256_setzero_si256();
+      #pragma GCC unroll 10
+      for (int k = 0; k <= 9; ++k)
+      {
+        __m256i eq = _mm256_cmpeq_epi8(t, _mm256_set1_epi8(k));
+        if (BORN_AT(k) && SURVIVE_AT(k))
+          r = _mm256_or_si256(r, _mm256_and_si256(eq, one));
+        else if (BORN_AT(k))
+          r = _mm256_or_si256(r, _mm256_and_si256(eq, _mm256_xor_si256(c, one)));
+        else if (SURVIVE_AT(k))
+          r = _mm256_or_si256(r, _mm256_and_si256(eq, c));
+      }
+      _mm256_storeu_si256((__m256i *) (out + x), r);
+      bchanged = _mm256_add_epi8(bchanged, _mm256_xor_si256(r, c));
+      blive = _mm256_add_epi8(blive, r);
+    }
+    changed = _mm256_add_epi64(changed, _mm256_sad_epu8(bchanged, zero));
+    live = _mm256_add_epi64(live, _mm256_sad_epu8(blive, zero));
+  }
+  *population += HSUM256(live);
+  return HSUM256(changed) + row_sse2_rule(up + x, mid + x, down + x, out + x, n - x, population, birth, survive);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+RULE_ROW_TEMPLATE long row_avx512_rule(const char * up, const char * mid, const char * down, char * out, int n,
+                                       long * population, const int birth, const int survive)
+{
+  const __m512i one = _mm512_set1_epi8(1), zero = _mm512_setzero_si512();
+  __m512i changed = zero, live = zero;
+  int x = 0;
+
+  while (x + 64 <= n)
+  {
+    __m512i bchanged = zero, blive = zero;
+    for (int i = 0; i < COUNT_CHUNK && x + 64 <= n; ++i, x += 64)
+    {
+      __m512i t = _mm512_add_epi8(_mm512_add_epi8(LOAD3(void, _mm512_loadu_si512, _mm512_add_epi8, up + x),
+                                                  LOAD3(void, _mm512_loadu_si512, _mm512_add_epi8, mid + x)),
+                                  LOAD3(void, _mm512_loadu_si512, _mm512_add_epi8, down + x));
+      __m512i c = _mm512_loadu_si512((const void *) (mid + x));
+      /* cells taking value 1, or the value of the cell, resp. its negation */
+      __mmask64 any = 0, alive = 0, dead = 0;
+      #pragma GCC unroll 10
+      for (int k = 0; k <= 9; ++k)
+      {
+        __mmask64 eq = _mm512_cmpeq_epi8_mask(t, _mm512_set1_epi8(k));
+        if (BORN_AT(k) && SURVIVE_AT(k))
+          any |= eq;
+        else if (BORN_AT(k))
+          dead |= eq;
+        else if (SURVIVE_AT(k))
+          alive |= eq;
+      }
+      __m512i r = _mm512_or_si512(_mm512_maskz_mov_epi8(any, one),
+                                  _mm512_or_si512(_mm512_maskz_mov_epi8(alive, c),
+                                                  _mm512_maskz_mov_epi8(dead, _mm512_xor_si512(c, one))));
+      _mm512_storeu_si512((void *) (out + x), r);
+      bchanged = _mm512_add_epi8(bchanged, _mm512_xor_si512(r, c));
+      blive = _mm512_add_epi8(blive, r);
+    }
+    changed = _mm512_add_epi64(changed, _mm512_sad_epu8(bchanged, zero));
+    live = _mm512_add_epi64(live, _mm512_sad_epu8(blive, zero));
+  }
+  *population += _mm512_reduce_add_epi64(live);
+  return _mm512_reduce_add_epi64(changed) + row_avx2_rule(up + x, mid + x, down + x, out + x, n - x, population, birth, survive);
+}
+
+/* table-driven rows for any other rule: the next state is shuffled out of
+ * two 16-entry tables indexed by t, for dead and live cells */
+static char rule_dead[16], rule_alive[16];
+
+__attribute__((target("avx2,popcnt")))
+static long row_avx2_table(const char * up, const char * mid, const char * down, char * out, int n, long * population)
+{
+  const __m256i tdead  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) rule_dead)),
+                talive = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) rule_alive)),
+                zero   = _mm256_setzero_si256();
+  __m256i changed = zero, live = zero;
+  int x = 0;
+
+  while (x + 32 <= n)
+  {
+    __m256i bchanged = zero, blive = zero;
+    for (int i = 0; i < COUNT_CHUNK && x + 32 <= n; ++i, x += 32)
+    {
+      __m256i t = _mm256_add_epi8(_mm256_add_epi8(LOAD3(__m256i, _mm256_loadu_si256, _mm256_add_epi8, up + x),
+                                                  LOAD3(__m256i, _mm256_loadu_si256, _mm256_add_epi8, mid + x)),
+                                  LOAD3(__m256i, _mm256_loadu_si256, _mm256_add_epi8, down + x));
+      __m256i c = _mm256_loadu_si256((const __m256i *) (mid + x));
+      __m256i r = _mm256_blendv_epi8(_mm256_shuffle_epi8(tdead, t), _mm256_shuffle_epi8(talive, t),
+                                     _mm256_cmpgt_epi8(c, zero));
+      _mm256_storeu_si256((__m256i *) (out + x), r);
+      bchanged = _mm256_add_epi8(bchanged, _mm256_xor_si256(r, c));
+      blive = _mm256_add_epi8(blive, r);
+    }
+    changed = _mm256_add_epi64(changed, _mm256_sad_epu8(bchanged, zero));
+    live = _mm256_add_epi64(live, _mm256_sad_epu8(blive, zero));
+  }
+  *population += HSUM256(live);
+  return HSUM256(changed) + row_scalar_table(up + x, mid + x, down + x, out + x, n - x, population);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static long row_avx512_table(const char * up, const char * mid, const char * down, char * out, int n, long * population)
+{
+  const __m512i tdead  = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) rule_dead)),
+                talive = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) rule_alive)),
+                zero   = _mm512_setzero_si512();
+  __m512i changed = zero, live = zero;
+  int x = 0;
+
+  while (x + 64 <= n)
+  {
+    __m512i bchanged = zero, blive = zero;
+    for (int i = 0; i < COUNT_CHUNK && x + 64 <= n; ++i, x += 64)
+    {
+      __m512i t = _mm512_add_epi8(_mm512_add_epi8(LOAD3(void, _mm512_loadu_si512, _mm512_add_epi8, up + x),
+                                                  LOAD3(void, _mm512_loadu_si512, _mm512_add_epi8, mid + x)),
+                                  LOAD3(void, _mm512_loadu_si512, _mm512_add_epi8, down + x));
+      __m512i c = _mm512_loadu_si512((const void *) (mid + x));
+      __m512i r = _mm512_mask_shuffle_epi8(_mm512_shuffle_epi8(tdead, t),
+                                           _mm512_test_epi8_mask(c, c), talive, t);
+      _mm512_storeu_si512((void *) (out + x), r);
+      bchanged = _mm512_add_epi8(bchanged, _mm512_xor_si512(r, c));
+      blive = _mm512_add_epi8(blive, r);
+    }
+    changed = _mm512_add_epi64(changed, _mm512_sad_epu8(bchanged, zero));
+    live = _mm512_add_epi64(live, _mm512_sad_epu8(blive, zero));
+  }
+  *population += _mm512_reduce_add_epi64(live);
+  return _mm512_reduce_add_epi64(changed) + row_avx2_table(up + x, mid + x, down + x, out + x, n - x, population);
+}
+
+#endif
+
+/* instances of the row templates for a rule */
+#if(HAVE_X86)
+#define RULE_ROWS(name, birth, survive) \
+  static long row_scalar_##name(const char * up, const char * mid, const char * down, char * out, int n, long * population) \
+  { return row_scalar_rule(up, mid, down, out, n, population, birth, survive); } \
+  __attribute__((target("sse2,popcnt"))) \
+  static long row_sse2_##name(const char * up, const char * mid, const char * down, char * out, int n, long * population) \
+  { return row_sse2_rule(up, mid, down, out, n, population, birth, survive); } \
+  __attribute__((target("avx2,popcnt"))) \
+  static long row_avx2_##name(const char * up, const char * mid, const char * down, char * out, int n, long * population) \
+  { return row_avx2_rule(up, mid, down, out, n, population, birth, survive); } \
+  __attribute__((target("avx512f,avx512bw,popcnt"))) \
+  static long row_avx512_##name(const char * up, const char * mid, const char * down, char * out, int n, long * population) \
+  { return row_avx512_rule(up, mid, down, out, n, population, birth, survive); }
+#define RULE_ENTRY(name, birth, survive) \
+  {birth, survive, {row_avx512_##name, row_avx2_##name, row_sse2_##name, row_scalar_##name}}
+#define TABLE_ENTRY {-1, -1, {row_avx512_table, row_avx2_table, row_scalar_table, row_scalar_table}}
+#else
+#define RULE_ROWS(name, birth, survive) \
+  static long row_scalar_##name(const char * up, const char * mid, const char * down, char * out, int n, long * population) \
+  { return row_scalar_rule(up, mid, down, out, n, population, birth, survive); }
+#define RULE_ENTRY(name, birth, survive) {birth, survive, {row_scalar_##name}}
+#define TABLE_ENTRY {-1, -1, {row_scalar_table}}
+#endif
+
+RULE_ROWS(conway,   RULE_CONWAY_B,   RULE_CONWAY_S)
+RULE_ROWS(highlife, RULE_HIGHLIFE_B, RULE_HIGHLIFE_S)
+RULE_ROWS(daynight, RULE_DAYNIGHT_B, RULE_DAYNIGHT_S)
+RULE_ROWS(seeds,    RULE_SEEDS_B,    RULE_SEEDS_S)
+
+#if(HAVE_X86)
+static int has_avx512(void) { return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"); }
+static int has_avx2(void)   { return __builtin_cpu_supports("avx2"); }
+static int has_sse2(void)   { return __builtin_cpu_supports("sse2"); }
+#endif
+
+/* sorted from the fastest to the slowest, as the rows of `rules` */
+static const struct {
+  const char * name;
+  int (*supported)(void);
+} isas[] = {
+#if(HAVE_X86)
+  {"avx512", has_avx512},
+  {"avx2",   has_avx2},
+  {"sse2",   has_sse2},
+#endif
+  {"scalar", NULL},
+  {NULL, NULL}
+};
+
+#define NUM_ISAS (sizeof(isas) / sizeof(isas[0]) - 1)
+
+/* specialized rules, ended by the table-driven rows for any rule */
+static const struct {
+  int birth, survive;
+  row_fn row[NUM_ISAS];
+} rules[] = {
+  RULE_ENTRY(conway,   RULE_CONWAY_B,   RULE_CONWAY_S),
+  RULE_ENTRY(highlife, RULE_HIGHLIFE_B, RULE_HIGHLIFE_S),
+  RULE_ENTRY(daynight, RULE_DAYNIGHT_B, RULE_DAYNIGHT_S),
+  RULE_ENTRY(seeds,    RULE_SEEDS_B,    RULE_SEEDS_S),
+  TABLE_ENTRY
+};
+
+static row_fn simd_row = row_scalar_conway;
+
+row_fn simd_row_fn(const char * isa, int birth, int survive)
+{
+  int any = !strcmp(isa, "auto"), r = 0;
+
+#if(HAVE_X86)
+  __builtin_cpu_init();
+#endif
+
+  while (rules[r].birth >= 0 && (rules[r].birth != birth || rules[r].survive != survive))
+    ++r;
+  if (rules[r].birth < 0)
+  {
+    /* table-driven rows, indexed by the 3x3 sum including the cell */
+    for (int t = 0; t < 16; ++t)
+    {
+      rule_dead[t]  = t <= 8 && (birth >> t & 1);
+      rule_alive[t] = t >= 1 && t <= 9 && (survive >> (t-1) & 1);
+    }
+  }
+
+  for (int i = 0; isas[i].name; ++i)
+  {
+    if (any || !strcmp(isa, isas[i].name))
+    {
+      if (!isas[i].supported || isas[i].supported())
+        return rules[r].row[i];
+      if (!any)
+        fprintf(stderr, "Error: instruction set '%s' not supported by this CPU\n", isa);
+    }
+  }
+  return NULL;
+}
+
+static int init_simd(state * s)
+{
+  const options * opts = s->opts;
+
+  simd_row = opts ? simd_row_fn(opts->isa, opts->birth, opts->survive)
+                  : simd_row_fn(DEFAULT_ISA, RULE_CONWAY_B, RULE_CONWAY_S);
+  return simd_row != NULL;
+}
+
+static long evolve_simd(state * s)
+{
+  return evolve_rows(s, simd_row);
+}
+
+const gol_kernel simd_kernel = {"simd", init_simd, evolve_simd, NULL, NULL, NULL, 1, 1, 0, 1};
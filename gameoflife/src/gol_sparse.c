@@ -0,0 +1,234 @@
+/*
+ * Sparse evolve kernel
+ *
+ * Live cells are kept as a list of plane offsets, and each generation only
+ * visits the cells next to them: every live cell (halo included) adds one to
+ * the counters of its 3x3 neighborhood, and the cells whose counter was
+ * touched are the only ones that may be alive in the next generation. The
+ * cost is proportional to the population instead of the board size.
+ *
+ * Both planes of the state are kept up to date: cells of the generation
+ * before are cleared from `next` before writing the new ones, so that
+ * halos, output and the dense rows work as with any other kernel.
+ *
+ * When the population grows beyond 1/SPARSE_DENSE of the board, the kernel
+ * switches to dense vectorized rows, and back to the live-cell list when the
+ * population counted by the rows drops below 1/SPARSE_SPARSE of the board.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gol_common.h"
+
+/* a live cell costs about as much as 256 cells of vectorized rows */
+#define SPARSE_DENSE  256   /* switch to dense rows above cells/256 live */
+#define SPARSE_SPARSE 512   /* switch back to the list below cells/512 live */
+
+/* counter flag for cells outside the grid, which are never computed */
+#define RING 0x80
+
+typedef struct {
+  long * cells;      /* plane offsets from row 0 */
+  long n;            /* number of cells */
+  long size;         /* allocated cells */
+} cell_list;
+
+typedef struct {
+  int dense;             /* dense rows are in use */
+  cell_list live;        /* live grid cells of `space` */
+  cell_list prev;        /* live grid cells of `next` (generation before) */
+  cell_list touched;     /* cells with neighbor counts in this generation */
+  unsigned char * base;  /* neighbor counter block */
+  unsigned char * count; /* neighbor counters, indexed like the planes */
+  row_fn row;            /* row function for dense generations */
+  long sparse_gens;      /* generations computed from the list */
+  long dense_gens;       /* generations computed with dense rows */
+} sparse_state;
+
+static inline void push(cell_list * l, long cell)
+{
+  if (l->n == l->size)
+  {
+    l->size = l->size ? 2 * l->size : 1024;
+    l->cells = (long *) realloc(l->cells, l->size * sizeof(long));
+  }
+  l->cells[l->n++] = cell;
+}
+
+/* list the live grid cells of a plane */
+static void list_cells(state * s, const char * plane, cell_list * l)
+{
+  l->n = 0;
+  for (int y = 1; y <= s->rows; ++y)
+  {
+    const char * row = PLANE_ROW(plane, s->stride, y);
+    for (int x = 1; x <= s->cols; ++x)
+      if (row[x])
+        push(l, (long) y * s->stride + x);
+  }
+}
+
+static int init_sparse(state * s)
+{
+  const options * opts = s->opts;
+  sparse_state * ss;
+  int h = s->rows, w = s->cols;
+
+  if (s->halo != 1)
+  {
+    fprintf(stderr, "Error: sparse kernel requires a state with 1 cell halos\n");
+    return 0;
+  }
+
+  ss = (sparse_state *) calloc(1, sizeof(sparse_state));
+
+  /*
+   * counters of the whole plane plus two rows above and below, for the
+   * neighbors of the halo corners; all but the grid cells are flagged
+   */
+  ss->base = (unsigned char *) malloc((size_t)(h + 6) * s->stride);
+  memset(ss->base, RING, (size_t)(h + 6) * s->stride);
+  ss->count = ss->base + 2 * s->stride;
+  for (int y = 1; y <= h; ++y)
+    memset(ss->count + (size_t) y * s->stride + 1, 0, w);
+
+  ss->row = opts ? simd_row_fn(opts->isa, opts->birth, opts->survive)
+                 : simd_row_fn(DEFAULT_ISA, RULE_CONWAY_B, RULE_CONWAY_S);
+  ss->dense = 1;
+  s->kdata = ss;
+
+  return ss->row != NULL;
+}
+
+static long evolve_list(state * s, sparse_state * ss)
+{
+  long checksum = 0, stride = s->stride;
+  int h = s->rows, w = s->cols;
+  const char * space = s->space;
+  char * next = s->next;
+  unsigned char * count = ss->count;
+  cell_list * touched = &ss->touched;
+
+  /* live halo cells, which are rewritten every generation */
+  cell_list * halo = &ss->prev;
+  long first_halo = halo->n;
+  for (int x = 0; x <= w+1; ++x)
+  {
+    if (space[x])
+      push(halo, x);
+    if (space[(h+1) * stride + x])
+      push(halo, (h+1) * stride + x);
+  }
+  for (int y = 1; y <= h; ++y)
+  {
+    if (space[y * stride])
+      push(halo, y * stride);
+    if (space[y * stride + w+1])
+      push(halo, y * stride + w+1);
+  }
+
+  /* neighbor counts, the cell itself included */
+  touched->n = 0;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    const cell_list * src = pass ? halo : &ss->live;
+    for (long i = pass ? first_halo : 0; i < src->n; ++i)
+    {
+      long c = src->cells[i];
+      for (long dy = -stride; dy <= stride; dy += stride)
+        for (int dx = -1; dx <= 1; ++dx)
+          if (!(count[c + dy + dx]++ & ~RING))
+            push(touched, c + dy + dx);
+    }
+  }
+  halo->n = first_halo;
+
+  /* clear the generation before from `next` */
+  for (long i = 0; i < ss->prev.n; ++i)
+    next[ss->prev.cells[i]] = 0;
+
+  /* compute the touched cells, the new live list is built in `prev` */
+  ss->prev.n = 0;
+  for (long i = 0; i < touched->n; ++i)
+  {
+    long c = touched->cells[i];
+    int n = count[c];
+
+    if (n & RING)
+    {
+      count[c] = RING;
+      continue;
+    }
+    count[c] = 0;
+
+    int alive = space[c];
+    char cell = life_rule[alive][n - alive];
+    if (cell)
+    {
+      next[c] = 1;
+      push(&ss->prev, c);
+    }
+    checksum += cell != alive;
+  }
+
+  /* the planes are swapped after the generation */
+  cell_list tmp = ss->live;
+  ss->live = ss->prev;
+  ss->prev = tmp;
+  s->population = ss->live.n;
+
+  return checksum;
+}
+
+static long evolve_sparse(state * s)
+{
+  sparse_state * ss = (sparse_state *) s->kdata;
+  long cells = (long) s->rows * s->cols, checksum;
+
+  if (!ss->dense)
+  {
+    ++ss->sparse_gens;
+    checksum = evolve_list(s, ss);
+    if (ss->live.n > cells / SPARSE_DENSE)
+      ss->dense = 1;
+    return checksum;
+  }
+
+  ++ss->dense_gens;
+  checksum = evolve_rows(s, ss->row);
+  if (s->population < cells / SPARSE_SPARSE)
+  {
+    /* back to the lists; `next` becomes `space` after the generation */
+    list_cells(s, s->next, &ss->live);
+    list_cells(s, s->space, &ss->prev);
+    ss->dense = 0;
+  }
+  return checksum;
+}
+
+static void report_sparse(state * s)
+{
+  sparse_state * ss = (sparse_state *) s->kdata;
+  long total = ss->sparse_gens + ss->dense_gens;
+
+  printf("  Sparse generations: %ld of %ld (%.2f%%)\n", ss->sparse_gens, total,
+         total ? 100.0 * ss->sparse_gens / total : 0.0);
+}
+
+static void release_sparse(state * s)
+{
+  sparse_state * ss = (sparse_state *) s->kdata;
+
+  if (!ss)
+    return;
+
+  free(ss->live.cells);
+  free(ss->prev.cells);
+  free(ss->touched.cells);
+  free(ss->base);
+  free(ss);
+  s->kdata = NULL;
+}
+
+const gol_kernel sparse_kernel = {"sparse", init_sparse, evolve_sparse, NULL, release_sparse, report_sparse, 0, 1};
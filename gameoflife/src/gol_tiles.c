@@ -0,0 +1,199 @@
+/*
+ * Active tiles evolve kernel
+ *
+ * The board is split into square tiles, flagged when any of their cells
+ * changed in the last generation. A tile can only change if itself or any
+ * of its 8 neighbor tiles changed, or if the halo next to it did, so all
+ * other tiles are skipped. Their cells are already up to date, hence the
+ * checksum is still exact. A skipped tile did not change in the last
+ * generation either, so it holds the same cells in both planes of the state.
+ *
+ * The halo ring is compared with the one of the last generation, so that
+ * changes coming from the wraparound or from other processes are tracked.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gol_common.h"
+
+typedef struct {
+  int size;          /* tile edge */
+  int ny, nx;        /* number of tiles per column/row */
+  char * changed;    /* tile changed in the last generation */
+  char * active;     /* tile must be computed in the current generation */
+  char * halo;       /* halo ring of the last generation: top, bottom, left, right */
+  long * population; /* live cells of each tile */
+  row_fn row;        /* row function for computing the tiles */
+  long computed;     /* tiles computed */
+  long skipped;      /* tiles skipped */
+} tile_state;
+
+#define MIN(a,b) (a<b?a:b)
+#define MAX(a,b) (a>b?a:b)
+
+static int init_tiles(state * s)
+{
+  const options * opts = s->opts;
+  tile_state * ts;
+
+  if (!s->halo)
+  {
+    fprintf(stderr, "Error: tiles kernel requires a state with halos\n");
+    return 0;
+  }
+
+  ts = (tile_state *) malloc(sizeof(tile_state));
+  ts->size = opts ? opts->tile : DEFAULT_TILE;
+  ts->ny = (s->rows + ts->size - 1) / ts->size;
+  ts->nx = (s->cols + ts->size - 1) / ts->size;
+  ts->changed = (char *) malloc(ts->ny * ts->nx);
+  ts->active = (char *) malloc(ts->ny * ts->nx);
+  ts->halo = (char *) calloc(2 * (s->cols + 2) + 2 * s->rows, sizeof(char));
+  ts->population = (long *) calloc(ts->ny * ts->nx, sizeof(long));
+  ts->row = opts ? simd_row_fn(opts->isa, opts->birth, opts->survive)
+                 : simd_row_fn(DEFAULT_ISA, RULE_CONWAY_B, RULE_CONWAY_S);
+  ts->computed = 0;
+  ts->skipped = 0;
+
+  /* everything is new in the first generation */
+  memset(ts->changed, 1, ts->ny * ts->nx);
+  s->kdata = ts;
+
+  return ts->row != NULL;
+}
+
+/* activate the tiles containing cells [y0, y1] x [x0, x1] (1-based, clipped) */
+static void activate(state * s, tile_state * ts, int y0, int y1, int x0, int x1)
+{
+  y0 = MAX(y0, 1);
+  x0 = MAX(x0, 1);
+  y1 = MIN(y1, s->rows);
+  x1 = MIN(x1, s->cols);
+  for (int ty = (y0 - 1) / ts->size; ty <= (y1 - 1) / ts->size; ++ty)
+    for (int tx = (x0 - 1) / ts->size; tx <= (x1 - 1) / ts->size; ++tx)
+      ts->active[ty * ts->nx + tx] = 1;
+}
+
+/*
+ * Activate the tiles next to halo cells that changed since the last
+ * generation, and keep the current halo for the next one
+ */
+static void check_halo(state * s, tile_state * ts)
+{
+  int h = s->rows, w = s->cols;
+  char * top = ts->halo,
+       * bottom = top + w + 2,
+       * left = bottom + w + 2,
+       * right = left + h;
+
+  for (int x = 0; x <= w+1; ++x)
+  {
+    if (top[x] != SPACE(s, 0, x))
+    {
+      activate(s, ts, 1, 1, x-1, x+1);
+      top[x] = SPACE(s, 0, x);
+    }
+    if (bottom[x] != SPACE(s, h+1, x))
+    {
+      activate(s, ts, h, h, x-1, x+1);
+      bottom[x] = SPACE(s, h+1, x);
+    }
+  }
+  for (int y = 1; y <= h; ++y)
+  {
+    if (left[y-1] != SPACE(s, y, 0))
+    {
+      activate(s, ts, y-1, y+1, 1, 1);
+      left[y-1] = SPACE(s, y, 0);
+    }
+    if (right[y-1] != SPACE(s, y, w+1))
+    {
+      activate(s, ts, y-1, y+1, w, w);
+      right[y-1] = SPACE(s, y, w+1);
+    }
+  }
+}
+
+static long evolve_tiles(state * s)
+{
+  tile_state * ts = (tile_state *) s->kdata;
+  int h = s->rows, w = s->cols, size = ts->size;
+  long checksum = 0, population = 0, computed = 0, skipped = 0;
+
+  /* tiles next to changed tiles or changed halo cells */
+  memset(ts->active, 0, ts->ny * ts->nx);
+  check_halo(s, ts);
+  for (int ty = 0; ty < ts->ny; ++ty)
+  {
+    for (int tx = 0; tx < ts->nx; ++tx)
+    {
+      if (ts->changed[ty * ts->nx + tx])
+      {
+        for (int y1 = MAX(ty-1, 0); y1 <= MIN(ty+1, ts->ny-1); ++y1)
+          for (int x1 = MAX(tx-1, 0); x1 <= MIN(tx+1, ts->nx-1); ++x1)
+            ts->active[y1 * ts->nx + x1] = 1;
+      }
+    }
+  }
+
+  /* compute active tiles */
+  #pragma omp parallel for schedule(runtime) reduction(+:checksum,population,computed,skipped)
+  for (int t = 0; t < ts->ny * ts->nx; ++t)
+  {
+    long tile_checksum = 0, tile_population = 0;
+
+    if (!ts->active[t])
+    {
+      ts->changed[t] = 0;
+      population += ts->population[t];
+      ++skipped;
+      continue;
+    }
+
+    int y0 = (t / ts->nx) * size + 1, y1 = MIN(y0 + size, h + 1),
+        x0 = (t % ts->nx) * size + 1, n = MIN(size, w - x0 + 1);
+    for (int y = y0; y < y1; ++y)
+    {
+      tile_checksum += ts->row(SPACE_ROW(s, y-1) + x0, SPACE_ROW(s, y) + x0, SPACE_ROW(s, y+1) + x0,
+                               NEXT_ROW(s, y) + x0, n, &tile_population);
+    }
+    ts->changed[t] = tile_checksum > 0;
+    ts->population[t] = tile_population;
+    checksum += tile_checksum;
+    population += tile_population;
+    ++computed;
+  }
+  ts->computed += computed;
+  ts->skipped += skipped;
+  s->population = population;
+
+  return checksum;
+}
+
+static void report_tiles(state * s)
+{
+  tile_state * ts = (tile_state *) s->kdata;
+  long total = ts->computed + ts->skipped;
+
+  printf("  Tiles (%dx%d): %ld of %ld skipped (%.2f%%)\n",
+         ts->size, ts->size, ts->skipped, total,
+         total ? 100.0 * ts->skipped / total : 0.0);
+}
+
+static void release_tiles(state * s)
+{
+  tile_state * ts = (tile_state *) s->kdata;
+
+  if (!ts)
+    return;
+
+  free(ts->changed);
+  free(ts->active);
+  free(ts->halo);
+  free(ts->population);
+  free(ts);
+  s->kdata = NULL;
+}
+
+const gol_kernel tiles_kernel = {"tiles", init_tiles, evolve_tiles, NULL, release_tiles, report_tiles, 0, 1};
@@ -0,0 +1,272 @@
+/*
+ * Startup autotuner
+ *
+ * Every kernel that can run the rule and halo of a state is timed for a few
+ * generations on a copy of the state, with each tile edge (tiles kernel)
+ * and thread count, and the fastest combination is kept. With MPI, every
+ * rank times its own sub-board and the ranks agree on the combination with
+ * the lowest time of the slowest rank.
+ *
+ * Decisions are cached in a small per-machine file, keyed by host, ranks,
+ * local board shape, density class (live cells as a power of two fraction
+ * of the board), halo, rule and instruction set, so that later runs of the
+ * same shape skip the probe. The file is $GOL_TUNE_FILE, or
+ * $HOME/.gameoflife_tune.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <float.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gol_common.h"
+
+#define TUNE_FILE  ".gameoflife_tune"
+#define TUNE_CELLS (1 << 23) /* cell updates timed per candidate */
+#define TUNE_REPS  2         /* timed runs per candidate, the fastest counts */
+
+static const int tune_tiles[] = {32, 64, 128};
+
+typedef struct {
+  const char * kernel;
+  int tile;
+  int threads;
+} candidate;
+
+/* the kernel can run the rule and halo of the state, as checked by set_kernel */
+static int kernel_fits(const gol_kernel * k, const state * s, const options * opts)
+{
+  return !(s->halo > 1 && !k->deep_halo) && opts->ltl == k->ltl &&
+         (opts->ltl || k->any_rule || (opts->birth == RULE_CONWAY_B && opts->survive == RULE_CONWAY_S));
+}
+
+/* list the candidates, up to `max_threads` threads, or count them if `c` is NULL */
+static int list_candidates(const state * s, const options * opts, int max_threads, candidate * c)
+{
+  int n = 0;
+
+  for (int i = 0; get_kernel(i); ++i)
+  {
+    const gol_kernel * k = get_kernel(i);
+    int tiles = k == &tiles_kernel ? sizeof(tune_tiles) / sizeof(tune_tiles[0]) : 1;
+
+    if (!kernel_fits(k, s, opts))
+      continue;
+    for (int t = 1; ; t = 2*t < max_threads ? 2*t : max_threads)
+    {
+      for (int j = 0; j < tiles; ++j, ++n)
+      {
+        if (!c)
+          continue;
+        c[n].kernel = k->name;
+        c[n].tile = k == &tiles_kernel ? tune_tiles[j] : opts->tile;
+        c[n].threads = t;
+      }
+      if (t == max_threads)
+        break;
+    }
+  }
+  return n;
+}
+
+/* path of the cache file */
+static void tune_filename(char * path, size_t size)
+{
+  const char * file = getenv("GOL_TUNE_FILE"),
+             * home = getenv("HOME");
+
+  if (file)
+    snprintf(path, size, "%s", file);
+  else if (home)
+    snprintf(path, size, "%s/%s", home, TUNE_FILE);
+  else
+    snprintf(path, size, "%s", TUNE_FILE);
+}
+
+/* key of a state in the cache file, `population` of the whole board */
+static void tune_key(const state * s, const options * opts, int ranks, long population,
+                     char * key, size_t size)
+{
+  char host[256] = "localhost";
+  long cells = (long) s->rows * s->cols * ranks;
+  int density = 0;
+
+  /* 1/2^density of the cells are alive */
+  while (density < 16 && population << (density + 1) <= cells)
+    ++density;
+  gethostname(host, sizeof(host) - 1);
+  snprintf(key, size, "%s %d %d %d %d %d %s %s", host, ranks, s->rows, s->cols, density,
+           s->halo, opts->rule, opts->isa);
+}
+
+/* look up a key in the cache file, returns 1 if found */
+static int tune_lookup(const char * key, const candidate * c, int n, int * best, double * rate)
+{
+  char path[4096], line[4096], kernel[64];
+  size_t len = strlen(key);
+  int tile, threads, found = 0;
+  double r;
+  FILE * f;
+
+  tune_filename(path, sizeof(path));
+  if (!(f = fopen(path, "r")))
+    return 0;
+
+  /* the last decision for the key counts */
+  while (fgets(line, sizeof(line), f))
+  {
+    if (strncmp(line, key, len) || line[len] != ' ' ||
+        sscanf(line + len, "%63s %d %d %lf", kernel, &tile, &threads, &r) != 4)
+      continue;
+    for (int i = 0; i < n; ++i)
+      if (!strcmp(c[i].kernel, kernel) && c[i].tile == tile && c[i].threads == threads)
+      {
+        *best = i;
+        *rate = r;
+        found = 1;
+      }
+  }
+  fclose(f);
+  return found;
+}
+
+static void tune_store(const char * key, const candidate * c, double rate)
+{
+  char path[4096];
+  FILE * f;
+
+  tune_filename(path, sizeof(path));
+  if (!(f = fopen(path, "a")))
+  {
+    fprintf(stderr, "Warning: cannot write the autotuner cache %s\n", path);
+    return;
+  }
+  fprintf(f, "%s %s %d %d %.3e\n", key, c->kernel, c->tile, c->threads, rate);
+  fclose(f);
+}
+
+/* seconds per generation of a candidate on a copy of `s` */
+static double probe(const state * s, state * t, const options * opts, const candidate * c)
+{
+  options o = *opts;
+  long cells = (long) s->rows * s->cols;
+  int gens = TUNE_CELLS / cells;
+  double best = DBL_MAX;
+
+  gens = gens < 2 ? 2 : gens > 64 ? 64 : gens;
+  o.kernel = c->kernel;
+  o.tile = c->tile;
+  o.threads = c->threads;
+
+  for (int r = 0; r < TUNE_REPS; ++r)
+  {
+    for (int y = 0; y < s->rows + 2*s->halo; ++y)
+      memcpy(SPACE_ROW(t, y), SPACE_ROW(s, y), s->cols + 2*s->halo);
+    if (!set_kernel(t, &o))
+      return DBL_MAX;
+
+    /* one generation to warm up, halos are left as they are */
+    evolve(t);
+    double start = wall_time();
+    for (int g = 0; g < gens; ++g)
+      evolve(t);
+    double time = (wall_time() - start) / gens;
+    best = time < best ? time : best;
+  }
+  return best;
+}
+
+int autotune(state * s, options * opts)
+{
+  int ranks = 1, rank = 0, max_threads = 1, n, best = -1, cached = 0;
+  double rate = 0;
+  char key[512];
+  candidate * c;
+
+#ifdef _OPENMP
+  max_threads = omp_get_num_procs();
+#endif
+#ifdef _MPI_
+  MPI_Comm node;
+  int local_ranks, level;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  /* share the cores of a node among its ranks */
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+  MPI_Comm_size(node, &local_ranks);
+  MPI_Comm_free(&node);
+  max_threads = max_threads / local_ranks > 1 ? max_threads / local_ranks : 1;
+  MPI_Query_thread(&level);
+  if (level < MPI_THREAD_FUNNELED)
+    max_threads = 1;
+  MPI_Allreduce(MPI_IN_PLACE, &max_threads, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+#endif
+
+  n = list_candidates(s, opts, max_threads, NULL);
+  if (!n)
+    return 0;
+  c = (candidate *) malloc(n * sizeof(candidate));
+  list_candidates(s, opts, max_threads, c);
+
+  long population = count_population(s);
+#ifdef _MPI_
+  MPI_Allreduce(MPI_IN_PLACE, &population, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+#endif
+  tune_key(s, opts, ranks, population, key, sizeof(key));
+  if (!rank)
+    cached = tune_lookup(key, c, n, &best, &rate);
+#ifdef _MPI_
+  MPI_Bcast(&cached, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&best, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&rate, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+
+  if (!cached)
+  {
+    double * times = (double *) malloc(n * sizeof(double));
+    state t;
+
+    alloc_state(&t, s->rows, s->cols, s->halo);
+    for (int i = 0; i < n; ++i)
+      times[i] = probe(s, &t, opts, &c[i]);
+    free_state(&t);
+
+#ifdef _MPI_
+    /* a generation takes as long as the slowest rank */
+    MPI_Allreduce(MPI_IN_PLACE, times, n, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+    for (int i = 0; i < n; ++i)
+      if (times[i] < DBL_MAX && (best < 0 || times[i] < times[best]))
+        best = i;
+    if (best >= 0)
+    {
+      rate = (double) s->rows * s->cols * ranks / times[best];
+      if (!rank)
+        tune_store(key, &c[best], rate);
+    }
+    free(times);
+  }
+
+  if (best >= 0)
+  {
+    opts->kernel = c[best].kernel;
+    opts->tile = c[best].tile;
+    opts->threads = c[best].threads;
+    if (!rank)
+    {
+      printf("Autotune: kernel %s, tile %d, threads %d (%.3e cells/s, %s)\n",
+             opts->kernel, opts->tile, opts->threads, rate,
+             cached ? "cached" : "probed");
+      if (!cached)
+        printf("  %d candidates probed on the %d x %d %s\n", n, s->rows, s->cols,
+               ranks > 1 ? "local boards" : "board");
+    }
+  }
+  free(c);
+  return best >= 0;
+}
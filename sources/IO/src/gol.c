@@ -58,7 +58,10 @@ long evolve(state * s, state * snew)
       checksum += s->space[y][x] != snew->space[y][x];
     }
 
-  memcpy(s->space[0], snew->space[0], (s->rows+2)*(s->cols+2));
+  /* swap boards instead of copying back: snew keeps the old generation */
+  char ** tmp = s->space;
+  s->space = snew->space;
+  snew->space = tmp;
 
   return checksum;
 }